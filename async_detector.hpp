@@ -0,0 +1,133 @@
+#ifndef ASYNC_DETECTOR_HPP
+#define ASYNC_DETECTOR_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <coroutine> // Coroutine handles resumed by the pool.
+#include <optional> // Results of calls that may be cancelled.
+#include <exception> // Failures of jobs, rethrown in the caller.
+#include <functional> // Jobs run on the pool.
+#include <mutex> // Guards the detector between concurrent calls.
+#include <string> // Standard string class for filenames.
+#include "edge_detector.hpp" // Detectors run by the jobs.
+#include "thread_pool.hpp" // Worker pool the jobs run on.
+
+#if !defined(__cpp_impl_coroutine)
+#error "async_detector.hpp requires C++20 coroutines"
+#endif
+
+// PoolAwaitable runs a job on the thread pool when it is co_awaited. The awaiting coroutine
+// is suspended, so the thread that awaited (e.g. a reactor thread) is free meanwhile, and it
+// is resumed on the worker that finished the job with the job's result. A job that throws
+// still resumes the caller, and co_await rethrows its exception. Nothing runs unless the
+// awaitable is awaited.
+template<typename T>
+class PoolAwaitable{
+public:
+    explicit PoolAwaitable(std::function<T()> job, ThreadPool& pool = ThreadPool::instance())
+        : job(std::move(job)), pool(&pool){}
+
+    bool await_ready() const noexcept { return false; } // Always runs on the pool.
+    void await_suspend(std::coroutine_handle<> caller){
+        pool->submit([this, caller]{
+            try{
+                result.emplace(job());
+            } catch(...){
+                failure = std::current_exception();
+            }
+            caller.resume();
+        });
+    }
+    // The job's result, or its exception rethrown.
+    T await_resume(){
+        if(failure){
+            std::rethrow_exception(failure);
+        }
+        return std::move(*result);
+    }
+
+private:
+    std::function<T()> job; // Work to run on the pool.
+    ThreadPool* pool; // Pool the job is submitted to.
+    std::optional<T> result; // Set by the job before the caller resumes.
+    std::exception_ptr failure; // Set instead if the job threw.
+};
+
+// BasicAsyncDetector offers awaitable versions of load, detect and save for event-driven
+// callers: co_await detector.detect(...) runs the detector on the worker pool instead of
+// blocking the awaiting thread. Each call works on a copy of the detector taken when it is
+// made, so calls can overlap, and detect takes a CancellationToken that stops the work
+// between row bands, e.g. when a request times out.
+template<typename Scalar>
+class BasicAsyncDetector{
+public:
+    using Detector = BasicEdgeDetector<Scalar>; // Wrapped detector type.
+    using Matrix = typename Detector::Matrix; // Edge map type.
+    using DetectorType = typename Detector::DetectorType; // Detector selection.
+    using GradientType = typename Detector::GradientType; // Gradient direction selection.
+
+    // Constructors and destructors.
+    explicit BasicAsyncDetector(Detector detector = Detector(), ThreadPool& pool = ThreadPool::instance())
+        : detector(std::move(detector)), pool(&pool){}
+
+    BasicAsyncDetector(const BasicAsyncDetector&) = delete;
+    BasicAsyncDetector& operator=(const BasicAsyncDetector&) = delete;
+
+    // Decodes an image on the pool; calls made after it completes use the new image.
+    PoolAwaitable<bool> load(std::string filename){
+        Detector loader = snapshot();
+        return PoolAwaitable<bool>([this, loader, filename]() mutable {
+            if(!loader.loadImage(filename)){
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            return detector.setImage(loader.getImage());
+        }, *pool);
+    }
+
+    // Runs a detector on the pool. The result is empty if the call failed or was cancelled.
+    PoolAwaitable<std::optional<Matrix>> detect(DetectorType detector_type, GradientType direction,
+                                                CancellationToken token = CancellationToken()) const {
+        Detector worker = snapshot();
+        worker.setCancellation(std::move(token));
+        return PoolAwaitable<std::optional<Matrix>>([worker, detector_type, direction]() -> std::optional<Matrix> {
+            if(worker.cancelled()){
+                return std::nullopt;
+            }
+            Matrix edges;
+            if(!worker.applyDetector(detector_type, direction, edges)){
+                return std::nullopt;
+            }
+            return edges;
+        }, *pool);
+    }
+
+    // Writes an edge map to a PNG file on the pool.
+    PoolAwaitable<bool> save(std::string filename, Matrix edges) const {
+        Detector worker = snapshot();
+        return PoolAwaitable<bool>([worker, filename, edges = std::move(edges)]{
+            return worker.saveEdgeImage(filename, edges);
+        }, *pool);
+    }
+
+    // Copy of the detector with its current image and settings.
+    Detector snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return detector;
+    }
+
+    // Replaces the detector, e.g. to change its settings.
+    void setDetector(Detector detector){
+        std::lock_guard<std::mutex> lock(mutex);
+        this->detector = std::move(detector);
+    }
+
+private:
+    Detector detector; // Image and settings copied by every call.
+    ThreadPool* pool; // Pool the calls run on.
+    mutable std::mutex mutex; // Guards detector while a call copies or replaces it.
+};
+
+using AsyncDetector = BasicAsyncDetector<double>; // Double precision detector.
+using AsyncDetectorF = BasicAsyncDetector<float>; // Single precision detector.
+
+#endif // ASYNC_DETECTOR_HPP
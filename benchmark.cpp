@@ -0,0 +1,595 @@
+#include "edge_detector.hpp"
+#include "stb_image.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#if defined(__unix__)
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+// Times every detector and direction on synthetic and real images from 256x256 up to 16384x16384,
+// on pools of increasing size, and reports throughput, memory footprint and thread scaling.
+// Usage: benchmark [--sizes 256,1024,...] [--threads 1,2,...] [--repeat N] [--json file] [--float] [--no-counters] [image ...]
+// Real images default to one of the reference images in Images/ and are resampled to every size.
+// Results go to stdout as CSV and to the JSON file (benchmark.json by default).
+// On Linux, hardware counters (cycles, instructions, cache, TLB and branch misses) are read on every
+// worker of the pool around every timed run and reported per pixel; --no-counters turns them off.
+
+namespace {
+// Command line settings.
+struct Options{
+    std::vector<int> sizes{256, 512, 1024, 2048, 4096, 8192, 16384}; // Square image sizes.
+    std::vector<int> threads; // Pool sizes; powers of two up to the hardware threads by default.
+    int repeat = 5; // Timed runs per case, after one warm-up run.
+    std::string json_path = "benchmark.json"; // Machine-readable results.
+    bool single_precision = false; // Benchmark EdgeDetectorF instead of EdgeDetector.
+    bool counters = true; // Read hardware counters around the runs.
+    std::vector<std::string> image_paths; // Real images.
+};
+
+// Interleaved 8-bit pixels of one input image.
+struct Source{
+    std::string name; // "synthetic" or the file path.
+    int width = 0; // Width of the pixels.
+    int height = 0; // Height of the pixels.
+    int channels = 0; // Interleaved channels.
+    std::vector<unsigned char> pixels; // Row-major interleaved pixels.
+};
+
+// One timed detector and direction on one image size and pool size.
+struct Result{
+    std::string image; // Source name.
+    int size = 0; // Width and height.
+    std::string detector; // Detector name.
+    std::string direction; // Direction name.
+    int threads = 0; // Pool size.
+    int runs = 0; // Timed runs.
+    double median_ms = 0; // Median time of a run.
+    double min_ms = 0; // Fastest run.
+    double bytes_per_pixel = 0; // Input planes, output and scratch touched by a run, per pixel.
+    double speedup = 1; // Median time on the smallest pool over this one.
+    std::vector<double> events_per_pixel; // Mean count per run and pixel of every counter, negative if unavailable.
+};
+
+// Hardware events counted around the runs.
+struct Event{
+    const char* name; // Name in the reports.
+    std::uint32_t type; // perf_event_attr type.
+    std::uint64_t config; // perf_event_attr config.
+};
+
+#if defined(__linux__)
+// Cache events are encoded as cache | operation << 8 | result << 16
+constexpr std::uint64_t cache_read_miss(std::uint64_t cache){
+    return cache | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+}
+
+const std::vector<Event> events = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"l1d_misses", PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_L1D)},
+    {"llc_misses", PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_LL)},
+    {"dtlb_misses", PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_DTLB)},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+#else
+const std::vector<Event> events = {
+    {"cycles", 0, 0}, {"instructions", 0, 0}, {"l1d_misses", 0, 0},
+    {"llc_misses", 0, 0}, {"dtlb_misses", 0, 0}, {"branch_misses", 0, 0},
+};
+#endif
+
+// Counters of the events on the worker threads of one pool, summed over the workers. Every
+// worker opens its own counters (pid 0, no inherit): an inherited counter only receives a
+// thread's counts when the thread exits, which pool workers never do during a run. Each event
+// is opened on its own, so a machine missing some events (LLC on many virtual machines) still
+// reports the others; when perf_event_open is refused altogether (no PMU, perf_event_paranoid,
+// seccomp), every event is unavailable and only times are reported.
+class PerfCounters{
+public:
+    // Counter values at one moment, scaled for multiplexing; negative if unavailable.
+    using Reading = std::vector<double>;
+
+    explicit PerfCounters(bool enabled) : enabled(enabled), failed(events.size(), !enabled){
+#if !defined(__linux__)
+        failed.assign(events.size(), true);
+        error = "not supported on this platform";
+#endif
+    }
+    ~PerfCounters(){
+#if defined(__linux__)
+        for(const auto& thread_fds : fds){
+            for(int fd : thread_fds){
+                if(fd >= 0){
+                    close(fd);
+                }
+            }
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Opens the events for the calling thread; an event missing on any thread is unavailable
+    void attachThread(){
+#if defined(__linux__)
+        std::vector<int> thread_fds(events.size(), -1);
+        std::string thread_error;
+        for(std::size_t e = 0; enabled && e < events.size(); ++e){
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[e].type;
+            attr.config = events[e].config;
+            attr.exclude_kernel = 1; // Allowed with perf_event_paranoid up to 2
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            thread_fds[e] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if(thread_fds[e] < 0 && thread_error.empty()){
+                thread_error = std::strerror(errno);
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for(std::size_t e = 0; e < events.size(); ++e){
+            failed[e] = failed[e] || thread_fds[e] < 0;
+        }
+        if(error.empty()){
+            error = thread_error;
+        }
+        fds.push_back(std::move(thread_fds));
+#endif
+    }
+
+    // Marks every event unavailable, e.g. when the self-check fails
+    void disable(const std::string& reason){
+        failed.assign(events.size(), true);
+        error = reason;
+    }
+
+    bool available(std::size_t e) const { return !failed[e] && !fds.empty(); } // True if the event is counted on every worker.
+    bool anyAvailable() const { // True if any event is counted.
+        for(std::size_t e = 0; e < events.size(); ++e){
+            if(available(e)){
+                return true;
+            }
+        }
+        return false;
+    }
+    const std::string& firstError() const { return error; } // Why the first unavailable event could not be opened.
+
+    // Current values summed over the workers; an event multiplexed with others is
+    // extrapolated from the time it ran. Reading another thread's counter is exact
+    Reading read() const {
+        Reading values(events.size(), -1.0);
+#if defined(__linux__)
+        for(std::size_t e = 0; e < events.size(); ++e){
+            if(!available(e)){
+                continue;
+            }
+            double total = 0.0;
+            for(const auto& thread_fds : fds){
+                std::uint64_t data[3]; // Value, time enabled, time running
+                if(::read(thread_fds[e], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data))){
+                    total = -1.0;
+                    break;
+                }
+                total += data[2] > 0 ? static_cast<double>(data[0]) * data[1] / data[2] : 0.0;
+            }
+            values[e] = total;
+        }
+#endif
+        return values;
+    }
+
+private:
+    bool enabled; // False with --no-counters.
+    std::vector<bool> failed; // Events that could not be opened on some worker.
+    std::vector<std::vector<int>> fds; // Descriptors of every attached thread, one per event, -1 if unavailable.
+    std::string error; // First error from perf_event_open.
+    std::mutex mutex; // Guards attaching from several workers at once.
+};
+
+// "1,2,4" as numbers; non-positive entries are dropped
+std::vector<int> parse_list(const char* text){
+    std::vector<int> values;
+    std::stringstream stream(text);
+    std::string item;
+    while(std::getline(stream, item, ',')){
+        int value = std::atoi(item.c_str());
+        if(value > 0){
+            values.push_back(value);
+        }
+    }
+    return values;
+}
+
+// Smooth shading, a grid of discs and hashed noise, so every detector finds edges of all strengths
+Source synthetic(int size){
+    Source source;
+    source.name = "synthetic";
+    source.width = source.height = size;
+    source.channels = 3;
+    source.pixels.resize(static_cast<std::size_t>(size) * size * 3);
+    int cell = std::max(8, size / 16);
+    for(int i = 0; i < size; ++i){
+        for(int j = 0; j < size; ++j){
+            int di = i % cell - cell / 2;
+            int dj = j % cell - cell / 2;
+            bool disc = di * di + dj * dj < cell * cell / 9;
+            unsigned int noise = (static_cast<unsigned int>(i) * 2654435761u ^ static_cast<unsigned int>(j) * 40503u) >> 28;
+            unsigned char* pixel = &source.pixels[(static_cast<std::size_t>(i) * size + j) * 3];
+            pixel[0] = static_cast<unsigned char>((disc ? 200 : 255 * j / size) + noise);
+            pixel[1] = static_cast<unsigned char>((disc ? 40 : 255 * i / size) + noise);
+            pixel[2] = static_cast<unsigned char>((disc ? 120 : 128) + noise);
+        }
+    }
+    return source;
+}
+
+// Nearest-neighbour resampling of a real image to a square size
+Source resample(const Source& image, int size){
+    Source source;
+    source.name = image.name;
+    source.width = source.height = size;
+    source.channels = image.channels;
+    source.pixels.resize(static_cast<std::size_t>(size) * size * image.channels);
+    for(int i = 0; i < size; ++i){
+        const unsigned char* row = &image.pixels[static_cast<std::size_t>(i) * image.height / size * image.width * image.channels];
+        for(int j = 0; j < size; ++j){
+            std::copy_n(row + static_cast<std::size_t>(j) * image.width / size * image.channels, image.channels,
+                        &source.pixels[(static_cast<std::size_t>(i) * size + j) * image.channels]);
+        }
+    }
+    return source;
+}
+
+// Installed memory, 0 if unknown
+std::size_t physical_memory(){
+#if defined(__unix__) && defined(_SC_PHYS_PAGES)
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGE_SIZE);
+    if(pages > 0 && page_size > 0){
+        return static_cast<std::size_t>(pages) * static_cast<std::size_t>(page_size);
+    }
+#endif
+    return 0;
+}
+
+// Runs a job on a pool and waits for it; the job's parallel loops stay on that pool
+void run_on(ThreadPool& pool, const std::function<void()>& job){
+    std::promise<void> done;
+    pool.submit([&]{
+        job();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+// Runs body once on every worker of a pool, from a job already running on it: a loop of one
+// item per worker in which each item waits for all the others, so no worker takes two. Returns
+// false if some worker did not turn up within a second
+bool on_every_worker(ThreadPool& pool, const std::function<void()>& body){
+    int n_workers = static_cast<int>(pool.size());
+    std::atomic<int> arrived{0};
+    std::atomic<bool> complete{true};
+    pool.parallelFor(0, n_workers, [&](int begin, int end){
+        for(int k = begin; k < end; ++k){
+            body();
+            arrived.fetch_add(1);
+            auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+            while(arrived.load() < n_workers){
+                if(std::chrono::steady_clock::now() > give_up){
+                    complete = false;
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+    }, 1);
+    return complete;
+}
+
+// Quotes a string for JSON
+std::string json_string(const std::string& text){
+    std::string quoted = "\"";
+    for(char c : text){
+        if(c == '"' || c == '\\'){
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// Times every case for one precision
+template<typename Scalar>
+int run(const Options& options){
+    using Detector = BasicEdgeDetector<Scalar>;
+    using ImageData = typename Detector::ImageData;
+    using Clock = std::chrono::steady_clock;
+
+    const std::vector<std::pair<typename Detector::DetectorType, std::string>> detectors = {
+        {Detector::DetectorType::SOBEL, "SOBEL"},
+        {Detector::DetectorType::PREWITT, "PREWITT"},
+        {Detector::DetectorType::ROBERTSCROSS, "ROBERTSCROSS"},
+        {Detector::DetectorType::LOG, "LOG"},
+        {Detector::DetectorType::DOG, "DOG"},
+    };
+    const std::vector<std::pair<typename Detector::GradientType, std::string>> directions = {
+        {Detector::GradientType::X, "X"},
+        {Detector::GradientType::Y, "Y"},
+        {Detector::GradientType::MAG, "MAG"},
+    };
+
+    // Real images are decoded once and resampled per size
+    std::vector<Source> images;
+    for(const auto& path : options.image_paths){
+        Source image;
+        image.name = path;
+        unsigned char* pixels = stbi_load(path.c_str(), &image.width, &image.height, &image.channels, 0);
+        if(!pixels){
+            std::cerr << "Error loading image " << path << ", skipping it" << std::endl;
+            continue;
+        }
+        if(image.channels == 2){
+            std::cerr << "Unsupported number of channels in " << path << ", skipping it" << std::endl;
+            stbi_image_free(pixels);
+            continue;
+        }
+        image.pixels.assign(pixels, pixels + static_cast<std::size_t>(image.width) * image.height * image.channels);
+        stbi_image_free(pixels);
+        images.push_back(std::move(image));
+    }
+
+    std::vector<std::unique_ptr<ThreadPool>> pools;
+    for(int n_threads : options.threads){
+        pools.push_back(std::make_unique<ThreadPool>(n_threads));
+    }
+
+    // Every worker of every pool opens its own counters. A Sobel pass over 256x256 pixels runs
+    // far more than one instruction per pixel on the workers, so fewer counted means the
+    // counters miss the pool's work, and they are dropped rather than reported wrong
+    const std::size_t instructions = 1; // Index of the instruction counter in events.
+    std::vector<std::unique_ptr<PerfCounters>> counters;
+    for(auto& pool : pools){
+        counters.push_back(std::make_unique<PerfCounters>(options.counters));
+        PerfCounters& pool_counters = *counters.back();
+        if(!options.counters){
+            continue;
+        }
+        bool attached = false;
+        double counted = 0;
+        run_on(*pool, [&]{
+            attached = on_every_worker(*pool, [&]{ pool_counters.attachThread(); });
+            Detector detector;
+            Source check = synthetic(256);
+            auto image = std::make_shared<ImageData>();
+            typename Detector::Matrix edges;
+            PerfCounters::Reading before = pool_counters.read();
+            if(detector.fillImage(*image, check.pixels.data(), check.width, check.height, check.channels) && detector.setImage(image)){
+                detector.applyDetector(Detector::DetectorType::SOBEL, Detector::GradientType::MAG, edges);
+            }
+            PerfCounters::Reading after = pool_counters.read();
+            counted = after[instructions] - before[instructions];
+        });
+        if(!attached){
+            pool_counters.disable("not every worker of the pool could be reached");
+        } else if(pool_counters.available(instructions) && counted < 256.0 * 256.0){
+            pool_counters.disable("the workers' instructions were not counted");
+        }
+    }
+    if(options.counters && !counters.front()->anyAvailable()){
+        std::cerr << "Hardware counters unavailable (" << counters.front()->firstError() << "), reporting times only" << std::endl;
+    }
+
+    std::vector<Result> results;
+    std::size_t memory = physical_memory();
+    std::cout << "image,size,detector,direction,threads,runs,median_ms,min_ms,mpix_per_s,ns_per_pixel,bytes_per_pixel,speedup,efficiency";
+    for(const auto& event : events){
+        std::cout << "," << event.name << "_per_pixel";
+    }
+    std::cout << ",ipc" << std::endl;
+    for(int size : options.sizes){
+        // Input planes and grayscale, output and up to three full-size temporaries (LoG), plus the pixels
+        double pixels = static_cast<double>(size) * size;
+        double needed = pixels * (sizeof(Scalar) * (4 + 1 + 1 + 3) + 3);
+        if(memory > 0 && needed > 0.8 * memory){
+            std::cerr << "Skipping " << size << "x" << size << ": needs about " << needed / (1 << 30) << " GiB" << std::endl;
+            continue;
+        }
+
+        std::vector<Source> sources{synthetic(size)};
+        for(const auto& image : images){
+            sources.push_back(resample(image, size));
+        }
+        for(const auto& source : sources){
+            for(const auto& [detector_type, detector_name] : detectors){
+                for(const auto& [direction, direction_name] : directions){
+                    std::size_t first = results.size();
+                    for(std::size_t p = 0; p < pools.size(); ++p){
+                        Result result;
+                        result.image = source.name;
+                        result.size = size;
+                        result.detector = detector_name;
+                        result.direction = direction_name;
+                        result.threads = static_cast<int>(pools[p]->size());
+                        std::vector<double> times;
+                        std::vector<double> totals(events.size(), 0.0);
+                        const PerfCounters& pool_counters = *counters[p];
+                        run_on(*pools[p], [&]{
+                            // Decoded on the pool, so its planes are first touched by the threads that read them
+                            Detector detector;
+                            auto image = std::make_shared<ImageData>();
+                            if(!detector.fillImage(*image, source.pixels.data(), source.width, source.height, source.channels) || !detector.setImage(image)){
+                                return;
+                            }
+                            typename Detector::Matrix edges;
+                            detector.applyDetector(detector_type, direction, edges);
+                            // Large cases stop early once a second has been spent on them
+                            double total_ms = 0;
+                            for(int r = 0; r < options.repeat && (r == 0 || total_ms < 1000); ++r){
+                                // The counters are read outside the timed interval
+                                PerfCounters::Reading before = pool_counters.read();
+                                Clock::time_point start = Clock::now();
+                                detector.applyDetector(detector_type, direction, edges);
+                                times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+                                PerfCounters::Reading after = pool_counters.read();
+                                total_ms += times.back();
+                                for(std::size_t e = 0; e < events.size(); ++e){
+                                    totals[e] = before[e] < 0 || after[e] < 0 || totals[e] < 0 ? -1.0 : totals[e] + after[e] - before[e];
+                                }
+                            }
+                            result.bytes_per_pixel = detector.getMemoryStats().peak_bytes / pixels;
+                        });
+                        if(times.empty()){
+                            continue;
+                        }
+                        std::sort(times.begin(), times.end());
+                        result.runs = static_cast<int>(times.size());
+                        result.median_ms = times[times.size() / 2];
+                        result.min_ms = times.front();
+                        result.speedup = results.size() > first ? results[first].median_ms / result.median_ms : 1.0;
+                        for(double total : totals){
+                            result.events_per_pixel.push_back(total < 0 ? -1.0 : total / (result.runs * pixels));
+                        }
+                        results.push_back(result);
+
+                        double base_threads = results[first].threads;
+                        std::cout << result.image << "," << size << "," << detector_name << "," << direction_name << ","
+                                  << result.threads << "," << result.runs << "," << result.median_ms << "," << result.min_ms << ","
+                                  << pixels / (result.median_ms * 1e3) << "," << result.median_ms * 1e6 / pixels << ","
+                                  << result.bytes_per_pixel << "," << result.speedup << ","
+                                  << result.speedup * base_threads / result.threads;
+                        // Unavailable counters leave their fields empty
+                        for(double value : result.events_per_pixel){
+                            std::cout << ",";
+                            if(value >= 0){
+                                std::cout << value;
+                            }
+                        }
+                        std::cout << ",";
+                        if(result.events_per_pixel[0] > 0 && result.events_per_pixel[1] >= 0){
+                            std::cout << result.events_per_pixel[1] / result.events_per_pixel[0];
+                        }
+                        std::cout << std::endl;
+                    }
+                }
+            }
+        }
+    }
+
+    // One object per case, with the host and build they were measured on
+    std::ofstream json(options.json_path);
+    if(!json){
+        std::cerr << "Could not write " << options.json_path << std::endl;
+        return 1;
+    }
+    const NumaTopology& topology = NumaTopology::system();
+    json << "{\n  \"host\": {\"hardware_threads\": " << std::thread::hardware_concurrency()
+         << ", \"numa_nodes\": " << topology.size() << ", \"cpus\": " << topology.cpus().size()
+         << ", \"memory_bytes\": " << memory << ", \"counters\": [";
+    bool listed = false;
+    for(std::size_t e = 0; e < events.size(); ++e){
+        bool counted = std::all_of(counters.begin(), counters.end(), [e](const auto& pool_counters){ return pool_counters->available(e); });
+        if(counted){
+            json << (listed ? ", " : "") << json_string(events[e].name);
+            listed = true;
+        }
+    }
+    json << "]},\n";
+    json << "  \"build\": {\"compiler\": " << json_string(__VERSION__)
+         << ", \"scalar\": " << json_string(sizeof(Scalar) == 4 ? "float" : "double")
+         << ", \"backend\": " << json_string(parallelBackendName(parallelBackend()))
+#if defined(__AVX2__)
+         << ", \"avx2\": true"
+#else
+         << ", \"avx2\": false"
+#endif
+#if defined(__FMA__)
+         << ", \"fma\": true"
+#else
+         << ", \"fma\": false"
+#endif
+         << "},\n";
+    json << "  \"timestamp\": " << static_cast<long long>(std::time(nullptr)) << ",\n  \"results\": [";
+    for(std::size_t k = 0; k < results.size(); ++k){
+        const Result& result = results[k];
+        double pixels = static_cast<double>(result.size) * result.size;
+        json << (k ? "," : "") << "\n    {\"image\": " << json_string(result.image) << ", \"width\": " << result.size
+             << ", \"height\": " << result.size << ", \"detector\": " << json_string(result.detector)
+             << ", \"direction\": " << json_string(result.direction) << ", \"threads\": " << result.threads
+             << ", \"runs\": " << result.runs << ", \"median_ms\": " << result.median_ms << ", \"min_ms\": " << result.min_ms
+             << ", \"mpix_per_s\": " << pixels / (result.median_ms * 1e3) << ", \"ns_per_pixel\": " << result.median_ms * 1e6 / pixels
+             << ", \"bytes_per_pixel\": " << result.bytes_per_pixel << ", \"speedup\": " << result.speedup;
+        // Counters per pixel, null when unavailable
+        for(std::size_t e = 0; e < events.size(); ++e){
+            json << ", \"" << events[e].name << "_per_pixel\": ";
+            if(result.events_per_pixel[e] >= 0){
+                json << result.events_per_pixel[e];
+            } else {
+                json << "null";
+            }
+        }
+        json << "}";
+    }
+    json << "\n  ]\n}\n";
+    return 0;
+}
+}
+
+int main(int argc, char** argv){
+
+    Options options;
+    for(int k = 1; k < argc; ++k){
+        std::string arg = argv[k];
+        bool has_value = k + 1 < argc;
+        if(arg == "--sizes" && has_value){
+            options.sizes = parse_list(argv[++k]);
+        } else if(arg == "--threads" && has_value){
+            options.threads = parse_list(argv[++k]);
+        } else if(arg == "--repeat" && has_value){
+            options.repeat = std::max(1, std::atoi(argv[++k]));
+        } else if(arg == "--json" && has_value){
+            options.json_path = argv[++k];
+        } else if(arg == "--float"){
+            options.single_precision = true;
+        } else if(arg == "--no-counters"){
+            options.counters = false;
+        } else if(arg.compare(0, 2, "--") == 0){
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        } else {
+            options.image_paths.push_back(arg);
+        }
+    }
+    if(options.image_paths.empty()){
+        options.image_paths = {"Images/000000_10_sobel.png"};
+    }
+    // 1, 2, 4, ... and the full machine
+    if(options.threads.empty()){
+        int hardware = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for(int n = 1; n < hardware; n *= 2){
+            options.threads.push_back(n);
+        }
+        options.threads.push_back(hardware);
+    }
+
+    calibrateTimer(); // So the stage times of the first runs convert at the final rate
+    return options.single_precision ? run<float>(options) : run<double>(options);
+}
@@ -0,0 +1,149 @@
+#include "bit_mask.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Resize to the given shape and clear every bit
+void BitMask::reshape(int rows, int cols){
+    n_rows = rows;
+    n_cols = cols;
+    words_per_row = (cols + 63) / 64;
+    bits.assign(static_cast<std::size_t>(rows) * words_per_row, 0);
+}
+
+// Write a single pixel
+void BitMask::set(int r, int c, bool value){
+    std::uint64_t bit = std::uint64_t(1) << (c & 63);
+    if(value){
+        row(r)[c >> 6] |= bit;
+    } else {
+        row(r)[c >> 6] &= ~bit;
+    }
+}
+
+// Pack a row of doubles: compare a vector of |values| against the threshold and movemask the result
+void BitMask::packRow(int r, const double* values, double threshold){
+    std::uint64_t* words = row(r);
+    for(int w = 0; w < words_per_row; ++w){
+        int begin = w * 64;
+        int end = std::min(begin + 64, n_cols);
+        std::uint64_t word = 0;
+        int j = begin;
+#if defined(__AVX__)
+        const __m256d sign = _mm256_set1_pd(-0.0);
+        const __m256d limit = _mm256_set1_pd(threshold);
+        for(; j + 4 <= end; j += 4){
+            __m256d magnitude = _mm256_andnot_pd(sign, _mm256_loadu_pd(values + j));
+            std::uint64_t lanes = static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(magnitude, limit, _CMP_GT_OQ)));
+            word |= lanes << (j - begin);
+        }
+#elif defined(__SSE2__)
+        const __m128d sign = _mm_set1_pd(-0.0);
+        const __m128d limit = _mm_set1_pd(threshold);
+        for(; j + 2 <= end; j += 2){
+            __m128d magnitude = _mm_andnot_pd(sign, _mm_loadu_pd(values + j));
+            std::uint64_t lanes = static_cast<unsigned>(_mm_movemask_pd(_mm_cmpgt_pd(magnitude, limit)));
+            word |= lanes << (j - begin);
+        }
+#endif
+        // Remaining columns
+        for(; j < end; ++j){
+            word |= static_cast<std::uint64_t>(std::abs(values[j]) > threshold) << (j - begin);
+        }
+        words[w] = word;
+    }
+}
+
+// Pack a row of floats; same as above with twice as many lanes per compare
+void BitMask::packRow(int r, const float* values, float threshold){
+    std::uint64_t* words = row(r);
+    for(int w = 0; w < words_per_row; ++w){
+        int begin = w * 64;
+        int end = std::min(begin + 64, n_cols);
+        std::uint64_t word = 0;
+        int j = begin;
+#if defined(__AVX__)
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+        const __m256 limit = _mm256_set1_ps(threshold);
+        for(; j + 8 <= end; j += 8){
+            __m256 magnitude = _mm256_andnot_ps(sign, _mm256_loadu_ps(values + j));
+            std::uint64_t lanes = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(magnitude, limit, _CMP_GT_OQ)));
+            word |= lanes << (j - begin);
+        }
+#elif defined(__SSE2__)
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        const __m128 limit = _mm_set1_ps(threshold);
+        for(; j + 4 <= end; j += 4){
+            __m128 magnitude = _mm_andnot_ps(sign, _mm_loadu_ps(values + j));
+            std::uint64_t lanes = static_cast<unsigned>(_mm_movemask_ps(_mm_cmpgt_ps(magnitude, limit)));
+            word |= lanes << (j - begin);
+        }
+#endif
+        // Remaining columns
+        for(; j < end; ++j){
+            word |= static_cast<std::uint64_t>(std::abs(values[j]) > threshold) << (j - begin);
+        }
+        words[w] = word;
+    }
+}
+
+// Total number of set pixels; padding bits are always zero so whole words can be counted
+std::size_t BitMask::count() const{
+    std::size_t total = 0;
+    for(std::uint64_t word : bits){
+        total += __builtin_popcountll(word);
+    }
+    return total;
+}
+
+// Number of set pixels in one row
+std::size_t BitMask::countRow(int r) const{
+    std::size_t total = 0;
+    const std::uint64_t* words = row(r);
+    for(int w = 0; w < words_per_row; ++w){
+        total += __builtin_popcountll(words[w]);
+    }
+    return total;
+}
+
+// Fraction of pixels that are set
+double BitMask::density() const{
+    std::size_t n_pixels = static_cast<std::size_t>(n_rows) * n_cols;
+    return n_pixels ? static_cast<double>(count()) / n_pixels : 0.0;
+}
+
+// Save as a binary PBM: rows of ceil(cols / 8) bytes, most significant bit first, 1 is black
+bool BitMask::savePBM(const std::string& filename) const{
+    std::ofstream file(filename, std::ios::binary);
+    if(!file){
+        std::cerr << "Failed to save image" << std::endl;
+        return false;
+    }
+    file << "P4\n" << n_cols << " " << n_rows << "\n";
+
+    int bytes_per_row = (n_cols + 7) / 8;
+    std::vector<unsigned char> line(bytes_per_row);
+    for(int r = 0; r < n_rows; ++r){
+        const std::uint64_t* words = row(r);
+        for(int b = 0; b < bytes_per_row; ++b){
+            // Our bytes are least significant bit first, PBM wants the opposite order
+            unsigned char byte = static_cast<unsigned char>(words[b >> 3] >> ((b & 7) * 8));
+            // Reverse the bits of the byte with the multiply-and-mask trick
+            byte = static_cast<unsigned char>(((byte * 0x0802LU & 0x22110LU) | (byte * 0x8020LU & 0x88440LU)) * 0x10101LU >> 16);
+            line[b] = byte;
+        }
+        file.write(reinterpret_cast<const char*>(line.data()), bytes_per_row);
+    }
+
+    if(!file){
+        std::cerr << "Failed to save image" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef BIT_MASK_HPP
+#define BIT_MASK_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <vector> // Storage for the packed words.
+#include <string> // Filenames for the PBM writer.
+#include <cstdint> // 64-bit words.
+#include <cstddef> // Size type for counts.
+
+// BitMask stores a binary edge mask with one bit per pixel. Each row starts on a fresh
+// 64-bit word; bit j % 64 of word j / 64 holds column j. Padding bits past the last column are zero.
+class BitMask{
+public:
+    // Constructors and destructors.
+    BitMask() = default; // Empty mask.
+    BitMask(int rows, int cols){ reshape(rows, cols); } // All-zero mask of the given size.
+
+    void reshape(int rows, int cols); // Resizes and clears the mask.
+
+    int rows() const { return n_rows; } // Mask height.
+    int cols() const { return n_cols; } // Mask width.
+    int wordsPerRow() const { return words_per_row; } // Row stride in 64-bit words.
+    std::uint64_t* row(int r){ return bits.data() + static_cast<std::size_t>(r) * words_per_row; } // Words of a row.
+    const std::uint64_t* row(int r) const { return bits.data() + static_cast<std::size_t>(r) * words_per_row; } // Words of a row.
+
+    bool get(int r, int c) const { return (row(r)[c >> 6] >> (c & 63)) & 1u; } // Reads one pixel.
+    void set(int r, int c, bool value); // Writes one pixel.
+
+    // Sets row r to (|values[j]| > threshold) for every column, using SIMD compare and movemask where available.
+    void packRow(int r, const double* values, double threshold);
+    void packRow(int r, const float* values, float threshold);
+
+    // Popcount-based density queries.
+    std::size_t count() const; // Number of set pixels.
+    std::size_t countRow(int r) const; // Number of set pixels in a row.
+    double density() const; // Fraction of set pixels.
+
+    bool savePBM(const std::string& filename) const; // Writes the mask as a binary (P4) PBM file.
+
+private:
+    int n_rows = 0; // Mask height.
+    int n_cols = 0; // Mask width.
+    int words_per_row = 0; // Words per row, rounded up.
+    std::vector<std::uint64_t> bits; // Packed rows.
+};
+
+#endif // BIT_MASK_HPP
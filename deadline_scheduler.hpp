@@ -0,0 +1,291 @@
+#ifndef DEADLINE_SCHEDULER_HPP
+#define DEADLINE_SCHEDULER_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <vector> // Heap of queued frames and lane threads.
+#include <array> // Cost estimates and counters per quality level.
+#include <algorithm> // Heap operations and percentiles.
+#include <chrono> // Deadlines and latencies.
+#include <future> // Results handed back to the submitter.
+#include <mutex> // Guards the queue and the statistics.
+#include <condition_variable> // Wakes lanes when frames arrive.
+#include <thread> // Lane threads.
+#include <memory> // Shared frames.
+#include <cstdint> // Frame numbers and counters.
+#include <string> // Lane names in traces.
+#include <exception> // Detector failures handed to the submitter.
+#include <stdexcept> // Rejecting empty frames.
+#include <iostream> // Error output.
+#include "edge_detector.hpp" // Detectors run on the frames.
+#include "trace.hpp" // Queue and frame events, when tracing.
+
+// Quality a frame was delivered at, best first.
+enum class FrameQuality{
+    FULL,       // The requested detector at full resolution.
+    REDUCED,    // A cheaper detector at full resolution: Roberts Cross for Sobel and Prewitt, Sobel for LoG and DoG.
+    HALF_SCALE, // Roberts Cross on the image halved in each direction, scaled back to full size.
+    SKIPPED,    // Not processed: the deadline had passed before a lane could start the frame.
+};
+
+// BasicDeadlineScheduler processes frames under per-frame deadlines rather than for raw
+// throughput. Queued frames are started earliest deadline first by a fixed number of lanes,
+// each running one frame at a time on the shared pool. Before a frame starts, its cost at
+// every quality level is predicted from the measured time per pixel of earlier frames, and
+// the best level expected to finish by the deadline is run; the cheapest level runs when none
+// is, and a frame whose deadline has already passed is skipped. The result reports the level
+// delivered, so callers see exactly when and how quality was traded for latency.
+template<typename Scalar>
+class BasicDeadlineScheduler{
+public:
+    using Detector = BasicEdgeDetector<Scalar>; // Detector type.
+    using Matrix = typename Detector::Matrix; // Edge map type.
+    using ImageData = typename Detector::ImageData; // Frame type.
+    using DetectorType = typename Detector::DetectorType; // Detector selection.
+    using GradientType = typename Detector::GradientType; // Gradient direction selection.
+    using Clock = std::chrono::steady_clock; // Clock of the deadlines.
+
+    // Outcome of one frame.
+    struct FrameResult{
+        std::uint64_t frame = 0; // Number of the frame, in submission order from 0.
+        Matrix edges; // Edge map, empty if the frame was skipped or failed.
+        FrameQuality quality = FrameQuality::SKIPPED; // Level delivered.
+        DetectorType detector = DetectorType::SOBEL; // Detector that ran.
+        bool met_deadline = false; // True if the edge map was ready by the deadline.
+        Clock::duration latency{}; // From submission to completion.
+    };
+
+    // Constructors and destructors.
+    // Starts the lanes; the detector's settings (sigma, border policy, ...) apply to every frame.
+    explicit BasicDeadlineScheduler(Detector detector = Detector(), int lanes = 1) : detector(std::move(detector)){
+        for(int lane = 0; lane < std::max(1, lanes); ++lane){
+            threads.emplace_back(&BasicDeadlineScheduler::lane_loop, this, lane);
+        }
+    }
+    // Processes the frames still queued, then stops the lanes.
+    ~BasicDeadlineScheduler(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        queue_cv.notify_all();
+        for(auto& thread : threads){
+            thread.join();
+        }
+    }
+
+    BasicDeadlineScheduler(const BasicDeadlineScheduler&) = delete;
+    BasicDeadlineScheduler& operator=(const BasicDeadlineScheduler&) = delete;
+
+    // Queues a frame that should be done by the deadline; the future receives its result, or
+    // the exception if the detector threw. A null frame is not queued and its future throws
+    // std::invalid_argument.
+    std::future<FrameResult> submit(std::shared_ptr<const ImageData> frame, DetectorType detector_type, GradientType direction,
+                                    Clock::time_point deadline){
+        if(!frame){
+            std::cerr << "Cannot schedule an empty frame" << std::endl;
+            std::promise<FrameResult> rejected;
+            rejected.set_exception(std::make_exception_ptr(std::invalid_argument("empty frame")));
+            return rejected.get_future();
+        }
+        Job job;
+        job.image = std::move(frame);
+        job.detector_type = detector_type;
+        job.direction = direction;
+        job.deadline = deadline;
+        job.submitted = Clock::now();
+        job.submitted_ticks = tracingEnabled() ? readTicks() : 0;
+        std::future<FrameResult> result = job.promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job.frame = next_frame++;
+            queue.push_back(std::move(job));
+            std::push_heap(queue.begin(), queue.end(), later_deadline);
+        }
+        queue_cv.notify_one();
+        return result;
+    }
+
+    // Statistics, safe to read from any thread.
+    std::size_t pending() const { std::lock_guard<std::mutex> lock(mutex); return queue.size(); } // Frames not started yet.
+    std::uint64_t deliveredCount(FrameQuality quality) const { std::lock_guard<std::mutex> lock(mutex); return delivered[static_cast<int>(quality)]; } // Frames delivered at a level.
+    std::uint64_t missedCount() const { std::lock_guard<std::mutex> lock(mutex); return missed; } // Frames finished late, skipped or failed.
+    // Latency below which the given fraction (e.g. 0.99) of the last latency_window frames finished.
+    Clock::duration latencyPercentile(double fraction) const {
+        std::vector<Clock::duration> sorted;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            sorted = latencies;
+        }
+        if(sorted.empty()){
+            return Clock::duration::zero();
+        }
+        std::size_t k = std::min(sorted.size() - 1, static_cast<std::size_t>(fraction * sorted.size()));
+        std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+        return sorted[k];
+    }
+
+private:
+    static constexpr int n_levels = 3; // Levels that run a detector.
+    static constexpr int n_detectors = 5; // Values of DetectorType.
+    static constexpr double cost_smoothing = 0.2; // Weight of the newest measurement in a cost estimate.
+    static constexpr std::size_t latency_window = 1024; // Latencies kept for the percentiles.
+
+    // A queued frame.
+    struct Job{
+        std::uint64_t frame = 0; // Submission number; breaks deadline ties in arrival order.
+        std::shared_ptr<const ImageData> image; // Frame to process.
+        DetectorType detector_type; // Requested detector.
+        GradientType direction; // Requested direction.
+        Clock::time_point deadline; // Time the edge map is needed by.
+        Clock::time_point submitted; // Time of submission.
+        std::uint64_t submitted_ticks = 0; // Timer at submission if traced, else 0.
+        std::promise<FrameResult> promise; // Receives the result.
+    };
+
+    // Name of the trace event of a frame delivered at a level.
+    static const char* quality_name(FrameQuality quality){
+        static const char* const names[] = {"FULL", "REDUCED", "HALF_SCALE", "SKIPPED"};
+        return names[static_cast<int>(quality)];
+    }
+
+    // Heap order: the earliest deadline comes out first.
+    static bool later_deadline(const Job& a, const Job& b){
+        return a.deadline != b.deadline ? a.deadline > b.deadline : a.frame > b.frame;
+    }
+
+    // Detector run at a level for a requested detector.
+    static DetectorType level_detector(DetectorType requested, int level){
+        if(level == static_cast<int>(FrameQuality::FULL)){
+            return requested;
+        }
+        if(level == static_cast<int>(FrameQuality::REDUCED)){
+            return requested == DetectorType::LOG || requested == DetectorType::DOG ? DetectorType::SOBEL : DetectorType::ROBERTSCROSS;
+        }
+        return DetectorType::ROBERTSCROSS;
+    }
+
+    // Predicted seconds per input pixel of a detector at full or half scale; 0 until measured.
+    double& cost(DetectorType detector_type, bool half_scale){
+        return costs[static_cast<int>(detector_type) * 2 + (half_scale ? 1 : 0)];
+    }
+
+    // Best level expected to finish by the deadline, else the cheapest; called with the lock held.
+    int plan(const Job& job, Clock::time_point now){
+        double pixels = static_cast<double>(job.image->width) * job.image->height;
+        double remaining = std::chrono::duration<double>(job.deadline - now).count();
+        for(int level = 0; level < n_levels; ++level){
+            // A cheaper detector that is the requested one gains nothing
+            if(level == static_cast<int>(FrameQuality::REDUCED) && level_detector(job.detector_type, level) == job.detector_type){
+                continue;
+            }
+            bool half_scale = level == static_cast<int>(FrameQuality::HALF_SCALE);
+            if(cost(level_detector(job.detector_type, level), half_scale) * pixels <= remaining){
+                return level;
+            }
+        }
+        return n_levels - 1;
+    }
+
+    // Lanes take the earliest deadline, run it at the planned level and learn from the time it took.
+    // A traced frame shows its time in the queue and then its run, named after the level delivered.
+    // A detector that throws fails only its frame: the exception goes to the frame's future and
+    // the frame counts as missed.
+    void lane_loop(int lane){
+        setTraceThreadName("deadline lane " + std::to_string(lane));
+        while(true){
+            Job job;
+            int level;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                queue_cv.wait(lock, [this]{ return stopping || !queue.empty(); });
+                if(queue.empty()){
+                    return;
+                }
+                std::pop_heap(queue.begin(), queue.end(), later_deadline);
+                job = std::move(queue.back());
+                queue.pop_back();
+                level = Clock::now() >= job.deadline ? static_cast<int>(FrameQuality::SKIPPED) : plan(job, Clock::now());
+            }
+
+            std::uint64_t started = tracingEnabled() ? readTicks() : 0;
+            if(started && job.submitted_ticks){
+                traceAsyncEvent("queued", "deadline", job.submitted_ticks, started, static_cast<std::int64_t>(job.frame));
+            }
+
+            FrameResult result;
+            result.frame = job.frame;
+            result.quality = static_cast<FrameQuality>(level);
+            Clock::time_point start = Clock::now();
+            std::exception_ptr failure; // Set if the detector threw.
+            if(result.quality != FrameQuality::SKIPPED){
+                bool half_scale = result.quality == FrameQuality::HALF_SCALE;
+                result.detector = level_detector(job.detector_type, level);
+                try{
+                    Detector worker = detector;
+                    bool ok = worker.setImage(job.image) &&
+                              (half_scale ? worker.applyDetectorHalfScale(result.detector, job.direction, result.edges)
+                                          : worker.applyDetector(result.detector, job.direction, result.edges));
+                    if(!ok){
+                        result.edges = Matrix();
+                    }
+                } catch(...){
+                    failure = std::current_exception();
+                    result.edges = Matrix();
+                }
+                // A failed run says nothing about the cost of the level
+                if(!failure){
+                    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+                    double per_pixel = seconds / (static_cast<double>(job.image->width) * job.image->height);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    double& estimate = cost(result.detector, half_scale);
+                    estimate = estimate == 0 ? per_pixel : (1 - cost_smoothing) * estimate + cost_smoothing * per_pixel;
+                }
+            }
+
+            Clock::time_point finished = Clock::now();
+            result.met_deadline = result.quality != FrameQuality::SKIPPED && result.edges.size() > 0 && finished <= job.deadline;
+            result.latency = finished - job.submitted;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(!failure){
+                    delivered[static_cast<int>(result.quality)]++;
+                }
+                if(!result.met_deadline){
+                    missed++;
+                }
+                if(latencies.size() < latency_window){
+                    latencies.push_back(result.latency);
+                } else {
+                    latencies[next_latency] = result.latency;
+                }
+                next_latency = (next_latency + 1) % latency_window;
+            }
+            if(started){
+                traceEvent(quality_name(result.quality), "deadline", started, readTicks(), static_cast<std::int64_t>(job.frame));
+            }
+            if(failure){
+                job.promise.set_exception(failure);
+            } else {
+                job.promise.set_value(std::move(result));
+            }
+        }
+    }
+
+    Detector detector; // Settings copied for every frame.
+    mutable std::mutex mutex; // Guards everything below.
+    std::condition_variable queue_cv; // Wakes lanes for new frames or shutdown.
+    std::vector<Job> queue; // Frames not started yet, a heap on the deadline.
+    std::uint64_t next_frame = 0; // Number of the next submitted frame.
+    bool stopping = false; // Set when the scheduler is being destroyed.
+    std::array<double, 2 * n_detectors> costs{}; // Seconds per pixel by detector and scale.
+    std::array<std::uint64_t, n_levels + 1> delivered{}; // Frames per quality level.
+    std::uint64_t missed = 0; // Frames finished late, failed or skipped.
+    std::vector<Clock::duration> latencies; // Latencies of the most recent frames.
+    std::size_t next_latency = 0; // Entry of latencies overwritten next.
+    std::vector<std::thread> threads; // Lane threads; started last, joined first.
+};
+
+using DeadlineScheduler = BasicDeadlineScheduler<double>; // Double precision scheduler.
+using DeadlineSchedulerF = BasicDeadlineScheduler<float>; // Single precision scheduler.
+
+#endif // DEADLINE_SCHEDULER_HPP
@@ -9,13 +9,21 @@
 #include "stb_image_write.h"
 
 // Load an image from a file using the STB library
-bool EdgeDetector::loadImage(std::string filename){
+template<typename Scalar>
+bool BasicEdgeDetector<Scalar>::loadImage(std::string filename){
+    // The stages of this call are kept for getStageStats
+    StageCall stage_call;
+
     // Variables to hold the image dimensions and the number of color channels
     int width, height, channels;
     
     // Load the image data into a unique_ptr to automatically manage memory
     // stbi_load loads the image file; stbi_image_free is called when the unique_ptr is destroyed
-    std::unique_ptr<unsigned char, void(*)(void*)> image_data(stbi_load(filename.c_str(), &width, &height, &channels, 0), stbi_image_free);
+    std::unique_ptr<unsigned char, void(*)(void*)> image_data(nullptr, stbi_image_free);
+    {
+        StageScope timer(Stage::DECODE);
+        image_data.reset(stbi_load(filename.c_str(), &width, &height, &channels, 0));
+    }
     
     // Check if image loading was successful
     if(!image_data){
@@ -27,57 +35,198 @@ bool EdgeDetector::loadImage(std::string filename){
     this->width = width;
     this->height = height;
     this->channels = channels;
-    in_image.clear(); // Clear any previous image data
 
-    // Divide the image data into separate matrices for each color channel
+    // The previous image's planes are reused unless another detector still shares them
+    return fillImage(writable_image(false), image_data.get(), width, height, channels);
+}
+
+// Split interleaved 8-bit pixels into the padded planes of an image, e.g. a frame ring slot
+template<typename Scalar>
+bool BasicEdgeDetector<Scalar>::fillImage(ImageData& image, const unsigned char* pixels, int width, int height, int channels) const {
+    StageCall stage_call;
+    // The unpacking handles up to four channels; with two (grey and alpha) the first is the luma
+    if(channels < 1 || channels > 4){
+        std::cerr << "Unsupported number of channels: " << channels << std::endl;
+        return false;
+    }
+    image.width = width;
+    image.height = height;
+    image.channels = channels;
+    image.planes.resize(channels);
+
+    // One padded plane per color channel, reused when the size is unchanged
     for(int c = 0; c < channels; ++c){
-        Eigen::MatrixXd temp_image_channel(height, width);
-        for(int i = 0; i < height; ++i){
-            for(int j = 0; j < width; ++j){
-                temp_image_channel(i, j) = image_data.get()[i * width * channels + j * channels + c];
+        Workspace::forThread().ensureSize(image.planes[c], height, width, halo);
+    }
+    // The grayscale plane is converted in the same pass, so detection never writes to the image;
+    // it is not kept when it would exceed the memory budget, and detection converts the rows it needs instead
+    std::size_t gray_bytes = PaddedLayout::make<Scalar>(height, width, halo).size() * sizeof(Scalar);
+    bool keep_gray = memory_budget == 0 || image.bytes() - image.gray.bytes() + gray_bytes <= memory_budget;
+    if(keep_gray){
+        Workspace::forThread().ensureSize(image.gray, height, width, halo);
+    } else {
+        image.gray = PaddedPlane();
+    }
+
+    // Blocks of rows that fill eight cache lines of every column, in parallel, and tiles of columns whose bytes stay in cache
+    constexpr int block_rows = 8 * static_cast<int>(AlignedAllocator<Scalar>::alignment / sizeof(Scalar));
+    constexpr int tile_cols = 64;
+    PlaneView planes[4];
+    for(int c = 0; c < channels; ++c){
+        planes[c] = image.planes[c].view();
+    }
+    PlaneView gray = image.gray.view();
+    StageTicks* call = StageCall::current();
+    parallel_for(0, (height + block_rows - 1) / block_rows, [&](int block_begin, int block_end){
+        StageBinding binding(call);
+        StageScope timer(Stage::UNPACK);
+        // De-interleaved rows of a tile, then the same bytes transposed into columns, per channel
+        unsigned char* tile_rows = Workspace::forThread().bytes(UNPACK_SLOT, 2 * channels * block_rows * tile_cols);
+        unsigned char* tile_columns = tile_rows + channels * block_rows * tile_cols;
+        for(int block = block_begin; block < block_end; ++block){
+            int i0 = block * block_rows;
+            int n_rows = std::min(block_rows, height - i0);
+            for(int j0 = 0; j0 < width; j0 += tile_cols){
+                int n_cols = std::min(tile_cols, width - j0);
+                // De-interleave every row of the tile into one byte row per channel
+                for(int k = 0; k < n_rows; ++k){
+                    unsigned char* channel_rows[4];
+                    for(int c = 0; c < channels; ++c){
+                        channel_rows[c] = tile_rows + (c * block_rows + k) * tile_cols;
+                    }
+                    deinterleaveRow(pixels + (static_cast<std::size_t>(i0 + k) * width + j0) * channels, n_cols, channels, channel_rows);
+                }
+                for(int c = 0; c < channels; ++c){
+                    transposeBytes(tile_rows + c * block_rows * tile_cols, tile_cols, n_rows, n_cols, tile_columns + c * block_rows * tile_cols, block_rows);
+                }
+                // Widen into the planes, a run of whole cache lines per column and channel, converting to grayscale on the way
+                for(int jj = 0; jj < n_cols; ++jj){
+                    const unsigned char* column_bytes[4];
+                    Scalar* column[4];
+                    for(int c = 0; c < channels; ++c){
+                        column_bytes[c] = tile_columns + (c * tile_cols + jj) * block_rows;
+                        column[c] = planes[c].col(j0 + jj) + i0;
+                    }
+                    unpackColumn(column_bytes, channels, n_rows, column, keep_gray ? gray.col(j0 + jj) + i0 : nullptr);
+                }
             }
         }
-        // Store the channel data
-        in_image.push_back(std::move(temp_image_channel));
+        streamFence();
+    });
+    // Fill the halo once so the kernels never test for borders
+    StageScope timer(Stage::UNPACK);
+    image.fillBorders(border_policy, border_constant);
+    return true;
+}
+
+// Run a parallel loop on the pool; once the call is cancelled the bands not started yet are skipped.
+// The bands' stage timers add to the call that started the loop, whichever thread runs them
+template<typename Scalar>
+void BasicEdgeDetector<Scalar>::parallel_bands(int begin, int end, FunctionRef<void(int, int)> body, int grain) const {
+    StageTicks* call = StageCall::current();
+    parallel_for(begin, end, [&](int band_begin, int band_end){
+        StageBinding binding(call);
+        if(!cancelled()){
+            body(band_begin, band_end);
+        }
+    }, grain);
+}
+
+// Use an image decoded by another detector; it is shared, not copied
+template<typename Scalar>
+bool BasicEdgeDetector<Scalar>::setImage(std::shared_ptr<const ImageData> image){
+    if(!image || image->planes.empty()){
+        std::cerr << "No image data available" << std::endl;
+        return false;
+    }
+    in_image = std::move(image);
+    own_image.reset(); // The caller's image may be const; it is only ever copied.
+    width = in_image->width;
+    height = in_image->height;
+    channels = in_image->channels;
+    // Only an image whose halo was filled with another policy has to be copied
+    if(!in_image->hasBorder(border_policy, border_constant)){
+        writable_image(true).fillBorders(border_policy, border_constant);
     }
     return true;
 }
 
+// Return the image for writing (copy-on-write). Only an image this detector created is written
+// in place, and only while own_image and in_image are its sole references; one passed to
+// setImage is always copied, since the caller may have created it const.
+template<typename Scalar>
+typename BasicEdgeDetector<Scalar>::ImageData& BasicEdgeDetector<Scalar>::writable_image(bool keep_contents){
+    bool sole_owner = own_image && own_image == in_image && own_image.use_count() == 2;
+    if(!sole_owner){
+        auto image = keep_contents && in_image ? std::make_shared<ImageData>(*in_image) : std::make_shared<ImageData>();
+        if(keep_contents && in_image){
+            Workspace::forThread().recordAllocation(image->bytes());
+        }
+        own_image = std::move(image);
+        in_image = own_image;
+    }
+    return *own_image;
+}
+
+// Set how pixels outside the image are read, and refill the halo of the loaded planes
+template<typename Scalar>
+void BasicEdgeDetector<Scalar>::setBorderPolicy(BorderPolicy policy, double constant){
+    border_policy = policy;
+    border_constant = static_cast<Scalar>(constant);
+    if(in_image && !in_image->hasBorder(border_policy, border_constant)){
+        writable_image(true).fillBorders(border_policy, border_constant);
+    }
+}
+
 // Save an image to a file in PNG format using the STB library
-bool EdgeDetector::saveImage(std::string filename, ImageType image_type){
+template<typename Scalar>
+bool BasicEdgeDetector<Scalar>::saveImage(std::string filename, ImageType image_type) const {
+    StageCall stage_call;
     // Check if there is image data to save
-    if(!in_image.size()){
+    if(!in_image){
         std::cerr << "No image data available" << std::endl;
         return false;
     }
 
     int saveChannels = 0; // Determine the number of channels to save based on the image type
-    std::vector<Eigen::MatrixXd> image; // Placeholder for image data
+    PlaneView image[3]; // Planes to save, referenced rather than copied
     
     // Set the number of channels to save based on the image type
     switch(image_type){
         case ImageType::COLOR:
-            saveChannels = 3; // Color images have 3 channels
-            image = in_image; // Use the original image data
+            saveChannels = std::min(channels, 3); // Color images have 3 channels
+            for(int c = 0; c < saveChannels; ++c){
+                image[c] = in_image->planes[c].view(); // Use the original image data
+            }
             break;
         case ImageType::GRAYSCALE:
             saveChannels = 1; // Grayscale images have 1 channel
-            // For grayscale, additional processing would be needed here to convert color images to grayscale
+            const PaddedPlane* gray = grayscale();
+            if(!gray){
+                return false;
+            }
+            image[0] = gray->view();
             break;
     }
 
     // Prepare the image data for saving
-    std::vector<unsigned char> image_data(width * height * saveChannels);
-    for(int c = 0; c < saveChannels; ++c){
-        for(int i = 0; i < height; ++i){
-            for(int j = 0; j < width; ++j){
-                image_data[i * width * saveChannels + j * saveChannels + c] = static_cast<unsigned char>(image[c](i, j));
+    unsigned char* image_data = Workspace::forThread().bytes(SAVE_SLOT, width * height * saveChannels);
+    StageTicks* call = StageCall::current();
+    parallel_for(0, height, [&](int row_begin, int row_end){
+        StageBinding binding(call);
+        StageScope timer(Stage::PACK);
+        for(int c = 0; c < saveChannels; ++c){
+            for(int i = row_begin; i < row_end; ++i){
+                for(int j = 0; j < width; ++j){
+                    image_data[i * width * saveChannels + j * saveChannels + c] = static_cast<unsigned char>(image[c](i, j));
+                }
             }
         }
-    }
+    });
 
     // Save the image data to a PNG file
-    if (!stbi_write_png(filename.c_str(), width, height, saveChannels, image_data.data(), width * saveChannels)) {
+    StageScope timer(Stage::ENCODE);
+    if (!stbi_write_png(filename.c_str(), width, height, saveChannels, image_data, width * saveChannels)) {
         std::cerr << "Failed to save image" << std::endl;
         return false;
     }
@@ -86,24 +235,32 @@ bool EdgeDetector::saveImage(std::string filename, ImageType image_type){
 }
 
 // Specifically for saving grayscale images derived from edge detection
-bool EdgeDetector::saveEdgeImage(std::string filename, Eigen::MatrixXd edges){
+template<typename Scalar>
+bool BasicEdgeDetector<Scalar>::saveEdgeImage(std::string filename, const Matrix& edges) const {
+    StageCall stage_call;
     // Ensure there is image data to work with
-    if(!in_image.size()){
+    if(!in_image){
         std::cerr << "No image data available" << std::endl;
         return false;
     }
 
     // Edge images are saved as single-channel grayscale images
     int saveChannels = 1;
-    std::vector<unsigned char> image_data(width * height * saveChannels);
-    for(int i = 0; i < height; ++i){
-        for(int j = 0; j < width; ++j){
-            image_data[i * width * saveChannels + j * saveChannels] = static_cast<unsigned char>(edges(i, j));
+    unsigned char* image_data = Workspace::forThread().bytes(SAVE_SLOT, width * height * saveChannels);
+    StageTicks* call = StageCall::current();
+    parallel_for(0, height, [&](int row_begin, int row_end){
+        StageBinding binding(call);
+        StageScope timer(Stage::PACK);
+        for(int i = row_begin; i < row_end; ++i){
+            for(int j = 0; j < width; ++j){
+                image_data[i * width * saveChannels + j * saveChannels] = static_cast<unsigned char>(edges(i, j));
+            }
         }
-    }
+    });
 
     // Write the edge image data to a PNG file
-    if (!stbi_write_png(filename.c_str(), width, height, saveChannels, image_data.data(), width * saveChannels)) {
+    StageScope timer(Stage::ENCODE);
+    if (!stbi_write_png(filename.c_str(), width, height, saveChannels, image_data, width * saveChannels)) {
         std::cerr << "Failed to save image" << std::endl;
         return false;
     }
@@ -111,67 +268,1021 @@ bool EdgeDetector::saveEdgeImage(std::string filename, Eigen::MatrixXd edges){
     return true;
 }
 
-// Convert the loaded image to grayscale
-bool EdgeDetector::convertToGrayscale() {
-    // Ensure the image has the correct number of channels for conversion
-    if (channels >= 3) { // For color images
-        // Apply standard formula to convert to grayscale
-        gray_image = 0.2989 * in_image[0] + 0.5870 * in_image[1] + 0.1140 * in_image[2];
-    } else if (channels == 1) { // For already grayscale images
-        gray_image = in_image[0]; // Directly use the single channel
-    } else {
-        std::cerr << "Unsupported number of channels: " << channels << std::endl;
+// Report an error unless an image is loaded
+template<typename Scalar>
+bool BasicEdgeDetector<Scalar>::has_image() const {
+    if(!in_image){
+        std::cerr << "No image data available" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// The grayscale plane of the image, or a conversion into the calling thread's scratch if the image has none
+template<typename Scalar>
+const typename BasicEdgeDetector<Scalar>::PaddedPlane* BasicEdgeDetector<Scalar>::grayscale() const {
+    if(!has_image()){
+        return nullptr;
+    }
+    if(in_image->gray.rows() > 0){
+        return &in_image->gray;
+    }
+    PaddedPlane& gray = Workspace::forThread().template plane<Scalar>(GRAY_PLANE, height, width, halo);
+    if(!convertToGrayscale(gray.interior())){
+        return nullptr;
+    }
+    gray.view().fillBorder(border_policy, border_constant);
+    return &gray;
+}
+
+// Convert rows of the loaded image to grayscale, writing into the given storage
+template<typename Scalar>
+bool BasicEdgeDetector<Scalar>::convertToGrayscale(Eigen::Ref<Matrix> gray, int row_begin) const {
+    if(!in_image){
+        std::cerr << "No image data available" << std::endl;
+        return false;
+    }
+    return convertToGrayscale(*in_image, gray, row_begin);
+}
+
+// Convert rows of an image to grayscale, writing into the given storage
+template<typename Scalar>
+bool BasicEdgeDetector<Scalar>::convertToGrayscale(const ImageData& image, Eigen::Ref<Matrix> gray, int row_begin) const {
+    int n_rows = static_cast<int>(gray.rows());
+    // Ensure the image has a number of channels the conversion knows
+    if (image.channels < 1 || image.channels > 4) {
+        std::cerr << "Unsupported number of channels: " << image.channels << std::endl;
         return false;
     }
+    // Columns in parallel, with the same per-pixel formula as the conversion at load
+    StageTicks* call = StageCall::current();
+    parallel_for(0, static_cast<int>(gray.cols()), [&](int col_begin, int col_end){
+        StageBinding binding(call);
+        StageScope timer(Stage::GRAYSCALE);
+        for(int j = col_begin; j < col_end; ++j){
+            Scalar* out = gray.col(j).data();
+            const Scalar* red = image.planes[0].view().col(j) + row_begin;
+            if (image.channels >= 3) { // For color images
+                const Scalar* green = image.planes[1].view().col(j) + row_begin;
+                const Scalar* blue = image.planes[2].view().col(j) + row_begin;
+                for(int i = 0; i < n_rows; ++i){
+                    out[i] = luma(red[i], green[i], blue[i]);
+                }
+            } else { // For grayscale images, with or without alpha
+                std::copy(red, red + n_rows, out); // Directly use the grey channel
+            }
+        }
+    });
     return true;
 }
 
 // Apply the specified edge detection algorithm to the image and return the result
-Eigen::MatrixXd EdgeDetector::applyDetector(DetectorType detector_type, GradientType direction){
-    // Convert the image to grayscale before detecting edges
-    this->convertToGrayscale();
+template<typename Scalar>
+typename BasicEdgeDetector<Scalar>::Matrix BasicEdgeDetector<Scalar>::applyDetector(DetectorType detector_type, GradientType direction) const {
+    Matrix edges;
+    applyDetector(detector_type, direction, edges);
+    return edges;
+}
+
+// Apply the detector to a batch of decoded images. Every image is one task on the pool; the
+// row bands of a large image are tasks of their own, so idle workers steal bands of the big
+// images once the small ones are done. A failed image leaves an empty matrix.
+template<typename Scalar>
+std::vector<typename BasicEdgeDetector<Scalar>::Matrix> BasicEdgeDetector<Scalar>::applyDetectorBatch(
+        const std::vector<std::shared_ptr<const ImageData>>& images, DetectorType detector_type, GradientType direction) const {
+    std::vector<Matrix> results(images.size());
+    batch_items(static_cast<int>(images.size()), [&](int i){
+        // A copy keeps the settings of this detector and shares nothing but immutable images
+        BasicEdgeDetector worker = *this;
+        if(worker.setImage(images[i])){
+            worker.applyDetector(detector_type, direction, results[i]);
+        }
+    });
+    return results;
+}
+
+// Apply the detector to a batch of image files, decoding each one inside its task
+template<typename Scalar>
+std::vector<typename BasicEdgeDetector<Scalar>::Matrix> BasicEdgeDetector<Scalar>::applyDetectorBatch(
+        const std::vector<std::string>& filenames, DetectorType detector_type, GradientType direction) const {
+    std::vector<Matrix> results(filenames.size());
+    batch_items(static_cast<int>(filenames.size()), [&](int i){
+        // Decoding inside the task places the image in the memory of the node that processes it
+        BasicEdgeDetector worker = *this;
+        worker.in_image.reset();
+        if(worker.loadImage(filenames[i])){
+            worker.applyDetector(detector_type, direction, results[i]);
+        }
+    });
+    return results;
+}
+
+// Run the items as pool tasks. With node pools, every NUMA node gets a contiguous share in
+// proportion to its CPUs and runs it on its own pinned pool, so the loops of an item stay on one node
+template<typename Scalar>
+void BasicEdgeDetector<Scalar>::batch_items(int n_items, FunctionRef<void(int)> item) const {
+    auto run = [&](int begin, int end){
+        for(int i = begin; i < end; ++i){
+            TraceScope trace("frame", "batch", i);
+            item(i);
+        }
+    };
+    const NumaTopology& topology = NumaTopology::system();
+    if(!node_pools || topology.size() < 2 || n_items < 2 || parallelBackend() != ParallelBackend::POOL){
+        parallel_bands(0, n_items, run, 1);
+        return;
+    }
+
+    std::size_t n_cpus = topology.cpus().size();
+    std::size_t cpus_before = 0;
+    std::mutex mutex;
+    std::condition_variable done;
+    int remaining = topology.size();
+    for(int index = 0; index < topology.size(); ++index){
+        int begin = static_cast<int>(n_items * cpus_before / n_cpus);
+        cpus_before += topology.nodes[index].size();
+        int end = static_cast<int>(n_items * cpus_before / n_cpus);
+        ThreadPool* pool = &ThreadPool::forNode(topology.ids[index]);
+        pool->submit([&, pool, begin, end]{
+            pool->parallelFor(begin, end, [&](int band_begin, int band_end){
+                if(!cancelled()){
+                    run(band_begin, band_end);
+                }
+            }, 1);
+            std::lock_guard<std::mutex> lock(mutex);
+            if(--remaining == 0){
+                done.notify_one();
+            }
+        });
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&]{ return remaining == 0; });
+}
+
+// Apply the specified edge detection algorithm, writing into the caller's matrix
+template<typename Scalar>
+bool BasicEdgeDetector<Scalar>::applyDetector(DetectorType detector_type, GradientType direction, Matrix& edges) const {
+    StageCall stage_call;
+    // Ensure there is image data to work with
+    if(!in_image){
+        std::cerr << "No image data available" << std::endl;
+        return false;
+    }
+    // The output is only reallocated when the image size changes
+    Workspace::forThread().ensureSize(edges, height, width);
+
+    // Fall back to strips when the whole-image temporaries would exceed the memory budget
+    int rows_per_strip = plan_strips(detector_type);
+    if(rows_per_strip < height){
+        bool done = strip_detector(edges, detector_type, direction, rows_per_strip);
+        trim_workspace();
+        return done;
+    }
+
+    // The grayscale image the kernels read
+    const PaddedPlane* gray = grayscale();
+    if(!gray){
+        return false;
+    }
     
     // Apply the chosen edge detection filter
     switch (detector_type){
         case DetectorType::SOBEL:
             // The function kernel_detector is assumed to apply the Sobel filter
-            return kernel_detector(detector_type, direction);
+            kernel_detector(edges, gray->view(), detector_type, direction);
+            break;
         case DetectorType::PREWITT:
             // Similarly for Prewitt filter
-            return kernel_detector(detector_type, direction);
+            kernel_detector(edges, gray->view(), detector_type, direction);
+            break;
         case DetectorType::ROBERTSCROSS:
             // And for Roberts Cross filter
-            return kernel_detector(detector_type, direction);
+            kernel_detector(edges, gray->view(), detector_type, direction);
+            break;
+        case DetectorType::LOG:
+            // Second-derivative detectors look for zero crossings instead
+            second_derivative_detector(edges, gray->interior(), detector_type, direction);
+            break;
+        case DetectorType::DOG:
+            second_derivative_detector(edges, gray->interior(), detector_type, direction);
+            break;
+    }
+    // LoG and DoG keep two responses and the horizontal filter pass besides the grayscale plane
+    bool second_derivative = detector_type == DetectorType::LOG || detector_type == DetectorType::DOG;
+    // A grayscale plane kept by the image is counted with the image, not as scratch
+    std::size_t gray_scratch = gray == &in_image->gray ? 0 : gray->bytes();
+    record_memory(gray_scratch + (second_derivative ? 3 * edges.size() * sizeof(Scalar) : 0), 1);
+    trim_workspace();
+    return !cancelled();
+}
+
+// Detect on the grayscale image averaged down over 2x2 blocks, then scale the map back up
+template<typename Scalar>
+bool BasicEdgeDetector<Scalar>::applyDetectorHalfScale(DetectorType detector_type, GradientType direction, Matrix& edges) const {
+    StageCall stage_call;
+    const PaddedPlane* gray = grayscale();
+    if(!gray){
+        return false;
+    }
+    // Too small to halve and still fit a 3x3 kernel
+    int rows = (height + 1) / 2;
+    int cols = (width + 1) / 2;
+    if(rows < 3 || cols < 3){
+        return applyDetector(detector_type, direction, edges);
+    }
+
+    // A box average is much cheaper than the pyramid's 5x5 blur; an odd last row or column
+    // averages with the halo
+    PaddedPlane& half = Workspace::forThread().template plane<Scalar>(HALF_PLANE, rows, cols, halo);
+    PlaneView source = gray->view();
+    PlaneView level = half.view();
+    parallel_bands(0, cols, [&](int col_begin, int col_end){
+        for(int j = col_begin; j < col_end; ++j){
+            const Scalar* left = source.col(2 * j);
+            const Scalar* right = source.col(2 * j + 1);
+            Scalar* out = level.col(j);
+            for(int i = 0; i < rows; ++i){
+                out[i] = Scalar(0.25) * (left[2 * i] + left[2 * i + 1] + right[2 * i] + right[2 * i + 1]);
+            }
+        }
+    });
+    level.fillBorder(border_policy, border_constant);
+
+    Scratch half_edges = Workspace::forThread().template matrix<Scalar>(HALF_SLOT, rows, cols);
+    bool second_derivative = detector_type == DetectorType::LOG || detector_type == DetectorType::DOG;
+    if(second_derivative){
+        second_derivative_detector(half_edges, half.interior(), detector_type, direction);
+    } else {
+        kernel_detector(half_edges, half.view(), detector_type, direction);
+    }
+
+    // A coarse gradient spans two full-scale pixels, so it is halved to stay in full-scale units;
+    // every coarse pixel covers a 2x2 block of the output
+    Scalar scale = second_derivative ? Scalar(1) : Scalar(0.5);
+    Workspace::forThread().ensureSize(edges, height, width);
+    parallel_bands(0, width, [&](int col_begin, int col_end){
+        for(int j = col_begin; j < col_end; ++j){
+            const Scalar* coarse = half_edges.col(j / 2).data();
+            Scalar* out = edges.col(j).data();
+            for(int i = 0; i < height; ++i){
+                out[i] = scale * coarse[i / 2];
+            }
+        }
+    });
+    return !cancelled();
+}
+
+// Apply a detector and derive a threshold from the magnitude histogram built during the same pass
+template<typename Scalar>
+typename BasicEdgeDetector<Scalar>::ThresholdResult BasicEdgeDetector<Scalar>::applyDetector(DetectorType detector_type, GradientType direction, ThresholdType threshold_type,
+                                                          double percentile, bool emit_mask) const {
+    ThresholdResult result;
+    applyDetector(detector_type, direction, threshold_type, result, percentile, emit_mask);
+    return result;
+}
+
+// The edges and the mask keep their buffers while the image size stays the same; the mask is
+// written in one pass once the histogram has given the threshold
+template<typename Scalar>
+bool BasicEdgeDetector<Scalar>::applyDetector(DetectorType detector_type, GradientType direction, ThresholdType threshold_type,
+                                              ThresholdResult& result, double percentile, bool emit_mask) const {
+    StageCall stage_call;
+    if(!in_image){
+        std::cerr << "No image data available" << std::endl;
+        return false;
+    }
+    // Strips when the memory budget requires them, otherwise the whole grayscale image
+    int rows_per_strip = plan_strips(detector_type);
+    bool tiled = rows_per_strip < height;
+    const PaddedPlane* gray = tiled ? nullptr : grayscale();
+    if(!tiled && !gray){
+        return false;
+    }
+    std::size_t gray_scratch = !gray || gray == &in_image->gray ? 0 : gray->bytes();
+
+    Histogram histogram;
+    // Both kinds of detector count their output band by band as they produce it
+    Workspace::forThread().ensureSize(result.edges, height, width);
+    if(tiled){
+        strip_detector(result.edges, detector_type, direction, rows_per_strip, &histogram);
+    } else if(detector_type == DetectorType::LOG || detector_type == DetectorType::DOG){
+        second_derivative_detector(result.edges, gray->interior(), detector_type, direction, &histogram, 0, height);
+        record_memory(gray_scratch + 3 * result.edges.size() * sizeof(Scalar), 1);
+    } else {
+        kernel_detector(result.edges, gray->view(), detector_type, direction, &histogram);
+        record_memory(gray_scratch, 1);
+    }
+
+    result.threshold = histogram_threshold(histogram, threshold_type, percentile);
+    trim_workspace();
+
+    if(emit_mask){
+        Workspace::forThread().ensureSize(result.mask, height, width);
+        Scalar threshold = static_cast<Scalar>(result.threshold);
+        result.mask.array() = (result.edges.array().abs() > threshold).template cast<unsigned char>() * static_cast<unsigned char>(255);
+    }
+    return !cancelled();
+}
+
+// Rows of context a strip needs above and below: the kernel halo, or the Gaussian radius
+// plus the row the vertical zero crossings look at
+template<typename Scalar>
+int BasicEdgeDetector<Scalar>::strip_margin(DetectorType detector_type) const {
+    switch(detector_type){
+        case DetectorType::LOG:
+            return static_cast<int>(std::ceil(3.0 * sigma)) + 1;
+        case DetectorType::DOG:
+            return static_cast<int>(std::ceil(3.0 * 1.6 * sigma)) + 1;
+        default:
+            return halo;
+    }
+}
+
+// Rows per strip that keep a call within the memory budget; the full height when the whole image fits
+template<typename Scalar>
+int BasicEdgeDetector<Scalar>::plan_strips(DetectorType detector_type) const {
+    if(memory_budget == 0){
+        return height;
+    }
+    // The decoded image and the output are resident whatever the strip size
+    std::size_t fixed = in_image->bytes() + static_cast<std::size_t>(height) * width * sizeof(Scalar);
+    bool second_derivative = detector_type == DetectorType::LOG || detector_type == DetectorType::DOG;
+    int margin = strip_margin(detector_type);
+    auto plane_bytes = [this](int rows){ return PaddedLayout::make<Scalar>(rows, width, halo).size() * sizeof(Scalar); };
+    // The two 1D kernels of LoG/DoG, no wider than the strip margin on each side
+    std::size_t kernel_bytes = second_derivative ? 2 * static_cast<std::size_t>(2 * margin + 1) * sizeof(Scalar) : 0;
+
+    // Whole image: the grayscale plane unless the image keeps one, plus two responses and the filter pass for LoG/DoG
+    std::size_t whole = (in_image->gray.rows() > 0 ? 0 : plane_bytes(height)) + kernel_bytes +
+                        (second_derivative ? 3 * static_cast<std::size_t>(height) * width * sizeof(Scalar) : 0);
+    // A strip: its grayscale rows, plus the same three planes and the strip output for LoG/DoG, margins included
+    auto strip_bytes = [&](int rows){
+        if(!second_derivative){
+            return plane_bytes(rows);
+        }
+        int strip_rows = std::min(height, rows + 2 * margin);
+        return plane_bytes(strip_rows) + kernel_bytes + 4 * static_cast<std::size_t>(strip_rows) * width * sizeof(Scalar);
+    };
+
+    int rows = height;
+    if(fixed + whole > memory_budget && fixed + strip_bytes(1) > memory_budget){
+        std::cerr << "Memory budget too small, processing one row at a time" << std::endl;
+        rows = 1;
+    } else if(fixed + whole > memory_budget){
+        // Largest strip that fits, by bisection since the strip size grows with its rows
+        int low = 1, high = height;
+        while(low < high){
+            int middle = (low + high + 1) / 2;
+            if(fixed + strip_bytes(middle) <= memory_budget){
+                low = middle;
+            } else {
+                high = middle - 1;
+            }
+        }
+        rows = low;
+    }
+    return rows;
+}
+
+// The calling thread's workspace counts against the budget: after a budgeted call it keeps the
+// buffers the call used and gives back the rest, largest first, until it fits in what the budget
+// leaves beside the image and the output
+template<typename Scalar>
+void BasicEdgeDetector<Scalar>::trim_workspace() const {
+    if(memory_budget == 0 || !in_image){
+        return;
+    }
+    std::size_t fixed = in_image->bytes() + static_cast<std::size_t>(height) * width * sizeof(Scalar);
+    Workspace::forThread().trim(memory_budget > fixed ? memory_budget - fixed : 0);
+}
+
+// Run the detector one strip of rows at a time, so only a strip of the grayscale image and of the
+// temporaries is live. Strips read the rows around them, so the output matches a whole-image run
+template<typename Scalar>
+bool BasicEdgeDetector<Scalar>::strip_detector(Eigen::Ref<Matrix> edges, DetectorType detector_type, GradientType direction,
+                                               int rows_per_strip, Histogram* histogram) const {
+    bool second_derivative = detector_type == DetectorType::LOG || detector_type == DetectorType::DOG;
+    int margin = strip_margin(detector_type);
+    std::size_t scratch = 0;
+    int strips = 0;
+    if(histogram){
+        histogram->bins.clear();
+    }
+
+    for(int r0 = 0; r0 < height; r0 += rows_per_strip, ++strips){
+        if(cancelled()){
+            return false;
+        }
+        int r1 = std::min(height, r0 + rows_per_strip);
+        if(second_derivative){
+            // The blurs clamp at the strip edges, so the strip extends by the margin on both sides
+            int s0 = std::max(0, r0 - margin);
+            int s1 = std::min(height, r1 + margin);
+            PaddedPlane& strip_image = Workspace::forThread().template plane<Scalar>(STRIP_PLANE, s1 - s0, width, halo);
+            if(!convertToGrayscale(strip_image.interior(), s0)){
+                return false;
+            }
+            Scratch strip_edges = Workspace::forThread().template matrix<Scalar>(STRIP_SLOT, s1 - s0, width);
+            // Only the rows of the strip itself are counted, not its margins
+            second_derivative_detector(strip_edges, strip_image.interior(), detector_type, direction, histogram, r0 - s0, r1 - s0);
+            edges.middleRows(r0, r1 - r0) = strip_edges.middleRows(r0 - s0, r1 - r0);
+            scratch = std::max(scratch, strip_image.bytes() + 4 * strip_edges.size() * sizeof(Scalar));
+        } else {
+            // The halo rows of the strip hold the neighbouring image rows; only at the image edges
+            // is the halo filled by the border policy
+            PaddedPlane& strip_image = Workspace::forThread().template plane<Scalar>(STRIP_PLANE, r1 - r0, width, halo);
+            PlaneView strip = strip_image.view();
+            int t0 = std::max(0, r0 - halo);
+            int t1 = std::min(height, r1 + halo);
+            Eigen::Map<Matrix, 0, Eigen::OuterStride<>> rows(strip.col(0) + (t0 - r0), t1 - t0, width, Eigen::OuterStride<>(strip.stride));
+            if(!convertToGrayscale(rows, t0)){
+                return false;
+            }
+            strip.fillBorder(border_policy, border_constant, r0 == 0, r1 == height);
+
+            // Strips share the bin width, so their counts add up to the whole-image histogram
+            kernel_detector(edges.middleRows(r0, r1 - r0), strip, detector_type, direction, histogram);
+            scratch = std::max(scratch, strip_image.bytes());
+        }
+    }
+    record_memory(scratch, strips);
+    return true;
+}
+
+// Statistics of the calling thread's last dense call
+template<typename Scalar>
+thread_local typename BasicEdgeDetector<Scalar>::MemoryStats BasicEdgeDetector<Scalar>::memory_stats;
+
+template<typename Scalar>
+const typename BasicEdgeDetector<Scalar>::MemoryStats& BasicEdgeDetector<Scalar>::getMemoryStats() const {
+    return memory_stats;
+}
+
+// Record the memory used by the last call: decoded image, output and the largest scratch set
+template<typename Scalar>
+void BasicEdgeDetector<Scalar>::record_memory(std::size_t scratch_bytes, int strips) const {
+    memory_stats.image_bytes = in_image ? in_image->bytes() : 0;
+    memory_stats.output_bytes = static_cast<std::size_t>(height) * width * sizeof(Scalar);
+    memory_stats.scratch_bytes = scratch_bytes;
+    memory_stats.peak_bytes = memory_stats.image_bytes + memory_stats.output_bytes + scratch_bytes;
+    memory_stats.strips = strips;
+}
+
+// Choose a threshold from the histogram: Otsu's method or a percentile of the counts
+template<typename Scalar>
+double BasicEdgeDetector<Scalar>::histogram_threshold(const Histogram& histogram, ThresholdType threshold_type, double percentile) const {
+    const auto& bins = histogram.bins;
+    int n_bins = static_cast<int>(bins.size());
+    std::uint64_t total = 0;
+    double weighted_total = 0.0;
+    for(int b = 0; b < n_bins; ++b){
+        total += bins[b];
+        weighted_total += static_cast<double>(b) * bins[b];
+    }
+    if(total == 0){
+        return 0.0;
+    }
+
+    switch(threshold_type){
+        case ThresholdType::OTSU: {
+            // Maximise the between-class variance w0 * w1 * (mu0 - mu1)^2
+            double best_variance = -1.0;
+            int best_bin = 0;
+            double weight_below = 0.0;
+            double sum_below = 0.0;
+            for(int b = 0; b < n_bins; ++b){
+                weight_below += bins[b];
+                sum_below += static_cast<double>(b) * bins[b];
+                double weight_above = total - weight_below;
+                if(weight_below == 0.0 || weight_above == 0.0){
+                    continue;
+                }
+                double mean_below = sum_below / weight_below;
+                double mean_above = (weighted_total - sum_below) / weight_above;
+                double variance = weight_below * weight_above * (mean_below - mean_above) * (mean_below - mean_above);
+                if(variance > best_variance){
+                    best_variance = variance;
+                    best_bin = b;
+                }
+            }
+            return (best_bin + 1) * histogram.bin_width;
+        }
+        case ThresholdType::PERCENTILE: {
+            // First bin at which the cumulative count reaches the requested fraction
+            percentile = std::min(std::max(percentile, 0.0), 1.0);
+            double target = percentile * total;
+            std::uint64_t cumulative = 0;
+            for(int b = 0; b < n_bins; ++b){
+                cumulative += bins[b];
+                if(cumulative >= target){
+                    return (b + 1) * histogram.bin_width;
+                }
+            }
+            return n_bins * histogram.bin_width;
+        }
+    }
+    return 0.0;
+}
+
+// Apply a detector and threshold its output straight into a bit-packed mask
+template<typename Scalar>
+BitMask BasicEdgeDetector<Scalar>::applyDetectorMask(DetectorType detector_type, GradientType direction, double threshold) const {
+    BitMask mask;
+    const PaddedPlane* gray = grayscale();
+    if(!gray){
+        return mask;
+    }
+    mask.reshape(height, width);
+    Scalar limit = static_cast<Scalar>(threshold);
+
+    // Rows are packed as soon as they are computed
+    detector_rows(*gray, detector_type, direction, [&](int row, const Scalar* values){
+        mask.packRow(row, values, limit);
+    });
+    return mask;
+}
+
+// Apply a detector and run-length encode the thresholded rows as they are produced
+template<typename Scalar>
+RunLengthMask BasicEdgeDetector<Scalar>::applyDetectorRLE(DetectorType detector_type, GradientType direction, double threshold) const {
+    const PaddedPlane* gray = grayscale();
+    if(!gray){
+        return RunLengthMask();
+    }
+    Scalar limit = static_cast<Scalar>(threshold);
+
+    // Every row is encoded independently; the constructor builds the row index
+    std::vector<std::vector<RunLengthMask::Run>> row_runs(height);
+    detector_rows(*gray, detector_type, direction, [&](int row, const Scalar* values){
+        RunLengthMask::encodeRow(values, width, limit, row_runs[row]);
+    });
+    return RunLengthMask(height, width, row_runs);
+}
+
+// Produce the detector output one row at a time and hand each row to the consumer,
+// rows in parallel; the consumer must be safe to call concurrently for different rows
+template<typename Scalar>
+void BasicEdgeDetector<Scalar>::detector_rows(const PaddedPlane& gray, DetectorType detector_type, GradientType direction,
+                                              FunctionRef<void(int, const Scalar*)> consume) const {
+    if(detector_type == DetectorType::LOG || detector_type == DetectorType::DOG){
+        // Zero crossings need whole-plane passes, so the rows are read from the dense output
+        Scratch edges = Workspace::forThread().template matrix<Scalar>(MASK_SLOT, height, width);
+        second_derivative_detector(edges, gray.interior(), detector_type, direction);
+        parallel_bands(0, height, [&](int row_begin, int row_end){
+            Scratch values = Workspace::forThread().template matrix<Scalar>(ROW_SLOT, width, 1);
+            for(int i = row_begin; i < row_end; ++i){
+                values = edges.row(i).transpose();
+                consume(i, values.data());
+            }
+        });
+        return;
+    }
+
+    Kernel Gx, Gy;
+    kernel_selector(detector_type, Gx, Gy);
+
+    // A band is computed a tile of rows at a time by the column kernels, then every row of the tile
+    // is copied out contiguously and consumed while the tile is still in cache; the dense edge map
+    // is never materialised
+    PlaneView source = gray.view();
+    parallel_bands(0, height, [&](int row_begin, int row_end){
+        Scratch tile = Workspace::forThread().template matrix<Scalar>(TILE_SLOT, tile_rows, width);
+        Scratch values = Workspace::forThread().template matrix<Scalar>(ROW_SLOT, width, 1);
+        for(int i0 = row_begin; i0 < row_end; i0 += tile_rows){
+            int n_rows = std::min(tile_rows, row_end - i0);
+            kernel_rows(tile, Gx, Gy, direction, source, i0, i0 + n_rows);
+            for(int k = 0; k < n_rows; ++k){
+                values = tile.row(k).transpose();
+                consume(i0 + k, values.data());
+            }
+        }
+    });
+}
+
+// List the pixels whose gradient magnitude exceeds the threshold, without a dense output.
+// Zero crossings need whole passes of the Gaussian filters, so LoG and DoG run a strip of rows
+// at a time, with the margin the filters read around it, as under a memory budget
+template<typename Scalar>
+typename BasicEdgeDetector<Scalar>::EdgeList BasicEdgeDetector<Scalar>::applyDetectorSparse(DetectorType detector_type, double threshold, bool with_orientation) const {
+    EdgeList edges;
+    if(!in_image){
+        std::cerr << "No image data available" << std::endl;
+        return edges;
+    }
+    Scalar limit = static_cast<Scalar>(threshold);
+    bool zero_crossing = detector_type == DetectorType::LOG || detector_type == DetectorType::DOG;
+    const PaddedPlane* gray = zero_crossing ? nullptr : grayscale();
+    if(!zero_crossing && !gray){
+        return edges;
+    }
+    if(zero_crossing){
+        // Zero crossings carry no gradient direction
+        with_orientation = false;
+    }
+
+    // Fixed bands so the output is ordered by row regardless of which thread ran which band
+    const int band_rows = 16;
+    int n_bands = (height + band_rows - 1) / band_rows;
+    std::vector<EdgeList> bands(n_bands);
+
+    // Strips are whole bands: at most sparse_strip_rows, fewer if the memory budget asks for it
+    int strip_rows = height;
+    int margin = strip_margin(detector_type);
+    Kernel Gx, Gy;
+    PlaneView source;
+    if(zero_crossing){
+        strip_rows = std::min(plan_strips(detector_type), sparse_strip_rows) / band_rows * band_rows;
+        strip_rows = std::max(strip_rows, band_rows);
+    } else {
+        kernel_selector(detector_type, Gx, Gy);
+        source = gray->view();
+    }
+
+    for(int r0 = 0; r0 < height; r0 += strip_rows){
+        int r1 = std::min(height, r0 + strip_rows);
+        int s0 = zero_crossing ? std::max(0, r0 - margin) : 0;
+        int s1 = zero_crossing ? std::min(height, r1 + margin) : 0;
+        Scratch response = Workspace::forThread().template matrix<Scalar>(STRIP_SLOT, s1 - s0, zero_crossing ? width : 0);
+        if(zero_crossing){
+            PaddedPlane& strip_image = Workspace::forThread().template plane<Scalar>(STRIP_PLANE, s1 - s0, width, halo);
+            if(!convertToGrayscale(strip_image.interior(), s0)){
+                return EdgeList();
+            }
+            second_derivative_detector(response, strip_image.interior(), detector_type, GradientType::MAG);
+        }
+
+        // Pass 1: every band of the strip collects its own edge points
+        parallel_bands(r0 / band_rows, (r1 + band_rows - 1) / band_rows, [&](int band_begin, int band_end){
+            // The X and Y responses of a band, computed by the column kernels
+            Scratch tile_x = Workspace::forThread().template matrix<Scalar>(TILE_SLOT, zero_crossing ? 0 : band_rows, width);
+            Scratch tile_y = Workspace::forThread().template matrix<Scalar>(SECOND_TILE_SLOT, zero_crossing ? 0 : band_rows, width);
+            for(int band = band_begin; band < band_end; ++band){
+                EdgeList& local = bands[band];
+                int i0 = band * band_rows;
+                int i1 = std::min(height, i0 + band_rows);
+                if(!zero_crossing){
+                    kernel_rows(tile_x, Gx, Gy, GradientType::X, source, i0, i1);
+                    kernel_rows(tile_y, Gx, Gy, GradientType::Y, source, i0, i1);
+                }
+                for(int i = i0; i < i1; ++i){
+                    for(int j = 0; j < width; ++j){
+                        Scalar gx = zero_crossing ? response(i - s0, j) : tile_x(i - i0, j);
+                        Scalar gy = zero_crossing ? Scalar(0) : tile_y(i - i0, j);
+                        Scalar magnitude = std::sqrt(gx * gx + gy * gy);
+                        if(magnitude > limit){
+                            local.x.push_back(j);
+                            local.y.push_back(i);
+                            local.magnitude.push_back(magnitude);
+                            if(with_orientation){
+                                local.orientation.push_back(std::atan2(gy, gx));
+                            }
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    // Exclusive prefix sum of the band sizes gives each band its place in the output
+    std::vector<std::size_t> offsets(n_bands + 1, 0);
+    for(int band = 0; band < n_bands; ++band){
+        offsets[band + 1] = offsets[band] + bands[band].size();
+    }
+    std::size_t total = offsets[n_bands];
+    edges.x.resize(total);
+    edges.y.resize(total);
+    edges.magnitude.resize(total);
+    if(with_orientation){
+        edges.orientation.resize(total);
+    }
+
+    // Pass 2: bands copy their points into the compacted arrays in parallel
+    parallel_bands(0, n_bands, [&](int band_begin, int band_end){
+        for(int band = band_begin; band < band_end; ++band){
+            const EdgeList& local = bands[band];
+            std::copy(local.x.begin(), local.x.end(), edges.x.begin() + offsets[band]);
+            std::copy(local.y.begin(), local.y.end(), edges.y.begin() + offsets[band]);
+            std::copy(local.magnitude.begin(), local.magnitude.end(), edges.magnitude.begin() + offsets[band]);
+            if(with_orientation){
+                std::copy(local.orientation.begin(), local.orientation.end(), edges.orientation.begin() + offsets[band]);
+            }
+        }
+    });
+
+    return edges;
+}
+
+// Combine the gradients of all colour channels through the Di Zenzo structure tensor
+template<typename Scalar>
+typename BasicEdgeDetector<Scalar>::ColorGradient BasicEdgeDetector<Scalar>::applyColorDetector(DetectorType detector_type) const {
+    ColorGradient result;
+
+    // Ensure there is image data to work with
+    if(!in_image){
+        std::cerr << "No image data available" << std::endl;
+        return result;
+    }
+    if(detector_type == DetectorType::LOG || detector_type == DetectorType::DOG){
+        std::cerr << "Colour detection needs a gradient detector" << std::endl;
+        return result;
+    }
+
+    Kernel Gx, Gy;
+    kernel_selector(detector_type, Gx, Gy);
+    int n_kernel = Gx.rows();
+
+    // Alpha is not a colour channel
+    int n_colors = channels >= 3 ? 3 : 1;
+    result.magnitude.resize(height, width);
+    result.direction.resize(height, width);
+
+    // Whole columns, border included: the kernel reads the halo of each channel
+    int length = height;
+    parallel_bands(0, width, [&](int col_begin, int col_end){
+        Scratch band = Workspace::forThread().template matrix<Scalar>(BAND_SLOT, length, 5);
+        auto gx = band.col(0).array();
+        auto gy = band.col(1).array();
+        auto gxx = band.col(2).array();
+        auto gyy = band.col(3).array();
+        auto gxy = band.col(4).array();
+        for(int j = col_begin; j < col_end; ++j){
+            gxx.setZero();
+            gyy.setZero();
+            gxy.setZero();
+            for(int c = 0; c < n_colors; ++c){
+                // Per-channel gradients for a whole column, built from shifted column segments
+                gx.setZero();
+                gy.setZero();
+                for(int b = 0; b < n_kernel; ++b){
+                    for(int a = 0; a < n_kernel; ++a){
+                        Eigen::Map<const Eigen::Array<Scalar, Eigen::Dynamic, 1>> segment(in_image->planes[c].view().col(j - 1 + b) + a - 1, length);
+                        if(Gx(a, b) != 0.0){
+                            gx += Gx(a, b) * segment;
+                        }
+                        if(Gy(a, b) != 0.0){
+                            gy += Gy(a, b) * segment;
+                        }
+                    }
+                }
+                // Accumulate the tensor entries across channels
+                gxx += gx.square();
+                gyy += gy.square();
+                gxy += gx * gy;
+            }
+            // Largest eigenvalue of [gxx gxy; gxy gyy] and the angle of its eigenvector
+            auto difference = gxx - gyy;
+            auto lambda = 0.5 * (gxx + gyy + (difference.square() + 4.0 * gxy.square()).sqrt());
+            result.magnitude.col(j) = lambda.sqrt().matrix();
+            for(int i = 0; i < length; ++i){
+                result.direction(i, j) = 0.5 * std::atan2(2.0 * gxy(i), difference(i));
+            }
+        }
+    });
+
+    return result;
+}
+
+// Detect edges on each channel separately, all channels in one parallel pass
+template<typename Scalar>
+typename BasicEdgeDetector<Scalar>::PlaneStack BasicEdgeDetector<Scalar>::applyDetectorPerChannel(DetectorType detector_type, GradientType direction) const {
+    PlaneStack edges;
+
+    // Ensure there is image data to work with
+    if(!in_image){
+        std::cerr << "No image data available" << std::endl;
+        return edges;
+    }
+
+    // One edge map per channel, all in a single allocation
+    edges.reshape(std::vector<std::pair<int, int>>(channels, {height, width}));
+
+    if(detector_type == DetectorType::LOG || detector_type == DetectorType::DOG){
+        // Second-derivative detectors parallelise inside each channel
+        for(int c = 0; c < channels; ++c){
+            second_derivative_detector(edges[c], in_image->planes[c].interior(), detector_type, direction);
+        }
+        return edges;
+    }
+
+    Kernel Gx, Gy;
+    kernel_selector(detector_type, Gx, Gy);
+
+    // Rows of all channels form one index range, so the pool balances across channels
+    parallel_bands(0, channels * height, [&](int begin, int end){
+        while(begin < end){
+            int c = begin / height;
+            int row_end = std::min(end, (c + 1) * height);
+            kernel_processor(edges[c], Gx, Gy, direction, in_image->planes[c].view(), begin - c * height, row_end - c * height);
+            begin = row_end;
+        }
+    });
+
+    return edges;
+}
+
+// Build a Gaussian pyramid of the grayscale image and detect edges on every level
+template<typename Scalar>
+typename BasicEdgeDetector<Scalar>::PlaneStack BasicEdgeDetector<Scalar>::applyDetectorPyramid(DetectorType detector_type, GradientType direction, int levels,
+                                                                                                  PlaneStack* pyramid) const {
+    PlaneStack edges;
+    // The levels go to the caller's stack when one is given
+    PlaneStack local_levels;
+    PlaneStack& pyramid_image = pyramid ? *pyramid : local_levels;
+
+    // Ensure there is image data to work with
+    if(!in_image){
+        std::cerr << "No image data available" << std::endl;
+        return edges;
     }
+    if(levels < 1){
+        std::cerr << "Pyramid needs at least one level" << std::endl;
+        return edges;
+    }
+
+    // Each level halves the previous one; stop early once a level is too small for a 3x3 kernel
+    std::vector<std::pair<int, int>> shapes{{height, width}};
+    while(static_cast<int>(shapes.size()) < levels){
+        int rows = (shapes.back().first + 1) / 2;
+        int cols = (shapes.back().second + 1) / 2;
+        if(rows < 3 || cols < 3){
+            break;
+        }
+        shapes.emplace_back(rows, cols);
+    }
+
+    // All levels, and all edge maps, live in one allocation each; the levels carry a halo wide
+    // enough for the downsampling kernel, filled with the border policy like every other plane
+    pyramid_image.reshape(shapes, pyramid_halo);
+    edges.reshape(shapes);
+
+    // Level 0 is the grayscale image itself, converted straight into the pyramid storage
+    if(!convertToGrayscale(pyramid_image[0])){
+        return PlaneStack();
+    }
+    pyramid_image.view(0).fillBorder(border_policy, border_constant);
+
+    // Second-derivative detectors need a wide footprint, so the levels are built first
+    // and the detector runs on each finished level
+    if(detector_type == DetectorType::LOG || detector_type == DetectorType::DOG){
+        for(int level = 0; level + 1 < pyramid_image.size(); ++level){
+            auto source = pyramid_image.view(level);
+            auto next = pyramid_image[level + 1];
+            parallel_bands(0, next.rows(), [&](int row_begin, int row_end){
+                pyramid_downsample(next, source, row_begin, row_end);
+            });
+            pyramid_image.view(level + 1).fillBorder(border_policy, border_constant);
+        }
+        for(int level = 0; level < pyramid_image.size(); ++level){
+            second_derivative_detector(edges[level], pyramid_image[level], detector_type, direction);
+        }
+        return edges;
+    }
+
+    Kernel Gx, Gy;
+    kernel_selector(detector_type, Gx, Gy);
+
+    // Building level k+1 reads the same rows of level k that the detector needs,
+    // so each band downsamples and detects in one go while those rows are in cache.
+    // A level's halo is filled as soon as the level is complete, before it is detected on
+    for(int level = 0; level + 1 < pyramid_image.size(); ++level){
+        auto source = pyramid_image.view(level);
+        auto next = pyramid_image[level + 1];
+        auto level_edges = edges[level];
+        parallel_bands(0, next.rows(), [&](int row_begin, int row_end){
+            pyramid_downsample(next, source, row_begin, row_end);
+            kernel_processor(level_edges, Gx, Gy, direction, source, 2 * row_begin, std::min(source.rows, 2 * row_end));
+        });
+        pyramid_image.view(level + 1).fillBorder(border_policy, border_constant);
+    }
+
+    // The coarsest level has no next level to fuse with
+    int last = pyramid_image.size() - 1;
+    auto last_source = pyramid_image.view(last);
+    auto last_edges = edges[last];
+    parallel_bands(0, last_source.rows, [&](int row_begin, int row_end){
+        kernel_processor(last_edges, Gx, Gy, direction, last_source, row_begin, row_end);
+    });
+
+    return edges;
 }
 
-// Processes the edges using the provided kernel
-void EdgeDetector::kernel_processor(Eigen::MatrixXd& edges, Eigen::MatrixXd kernel){
+// Blur rows of the source with a 5x5 binomial kernel and keep every second pixel. The kernel
+// is applied separably: for each output column the horizontal pass weighs five whole source
+// column segments into a workspace column, and the vertical pass weighs every second pixel of
+// it. Pixels outside the image come from the source halo, filled with the border policy
+template<typename Scalar>
+void BasicEdgeDetector<Scalar>::pyramid_downsample(Eigen::Ref<Matrix> level, const PlaneView& source, int row_begin, int row_end) const {
+    using Column = Eigen::Array<Scalar, Eigen::Dynamic, 1>;
+    using Decimated = Eigen::Map<const Column, 0, Eigen::InnerStride<2>>;
+    // Binomial approximation of a Gaussian
+    static const Scalar weights[5] = {Scalar(1.0 / 16), Scalar(4.0 / 16), Scalar(6.0 / 16), Scalar(4.0 / 16), Scalar(1.0 / 16)};
+    int length = row_end - row_begin;
+    if(length <= 0){
+        return;
+    }
+
+    // Source rows 2 * row_begin - 2 to 2 * row_end - 2 + 4 feed the band
+    int first = 2 * row_begin - 2;
+    int span = 2 * length + 3;
+    Scratch horizontal = Workspace::forThread().template matrix<Scalar>(PYRAMID_SLOT, span, 1);
+    auto blurred = horizontal.col(0).array();
+    for(int j = 0; j < level.cols(); ++j){
+        blurred = weights[0] * Eigen::Map<const Column>(source.col(2 * j - 2) + first, span);
+        for(int dx = 1; dx < 5; ++dx){
+            blurred += weights[dx] * Eigen::Map<const Column>(source.col(2 * j + dx - 2) + first, span);
+        }
+        auto out = level.col(j).segment(row_begin, length).array();
+        out = weights[0] * Decimated(horizontal.data(), length);
+        for(int dy = 1; dy < 5; ++dy){
+            out += weights[dy] * Decimated(horizontal.data() + dy, length);
+        }
+    }
+}
+
+// Processes the rows [row_begin, row_end) of the source using the provided kernels.
+// The source halo supplies the pixels outside the image, so every output pixel,
+// border included, is computed by the same branch-free column loop
+template<typename Scalar>
+void BasicEdgeDetector<Scalar>::kernel_processor(Eigen::Ref<Matrix> edges, const Kernel& Gx, const Kernel& Gy, GradientType direction,
+                                    const PlaneView& source, int row_begin, int row_end,
+                                    std::uint64_t* counts, double bin_width) const {
+    using Column = Eigen::Array<Scalar, Eigen::Dynamic, 1>;
     // Size of the kernel, assuming it's square
-    int n_kernel = kernel.rows();
-    
-    // Apply the kernel to each pixel (except the border pixels)
-    for(int i = 1; i < height - 1; ++i){
-        for(int j = 1; j < width - 1; ++j){
-            // Perform convolution operation
-            edges(i, j) = (kernel.array() * gray_image.block(i - 1, j - 1, n_kernel, n_kernel).array()).sum();
+    int n_kernel = Gx.rows();
+    int length = row_end - row_begin;
+    if(length <= 0){
+        return;
+    }
+
+    // Adds the shifted source column segments weighted by a kernel into out
+    auto convolve = [&](auto&& out, const Kernel& G, int j){
+        out.setZero();
+        for(int b = 0; b < n_kernel; ++b){
+            for(int a = 0; a < n_kernel; ++a){
+                if(G(a, b) != Scalar(0)){
+                    out += G(a, b) * Eigen::Map<const Column>(source.col(j - 1 + b) + row_begin - 1 + a, length);
+                }
+            }
+        }
+    };
+
+    // Walk down each column so reads follow Eigen's column-major layout; the timer is read
+    // once per column, and once per band for a single direction
+    StageLap timer;
+    Scratch band = Workspace::forThread().template matrix<Scalar>(BAND_SLOT, direction == GradientType::MAG ? length : 0, 2);
+    auto gx = band.col(0).array();
+    auto gy = band.col(1).array();
+    for(int j = 0; j < source.cols; ++j){
+        auto out = edges.col(j).segment(row_begin, length).array();
+        switch(direction){
+            case GradientType::X:
+                convolve(out, Gx, j);
+                break;
+            case GradientType::Y:
+                convolve(out, Gy, j);
+                break;
+            case GradientType::MAG:
+                // Combine the X and Y gradients to get the edge magnitude
+                convolve(gx, Gx, j);
+                convolve(gy, Gy, j);
+                timer.lap(Stage::CONVOLUTION);
+                // std::sqrt is correctly rounded, unlike Eigen's fast float sqrt
+                for(int i = 0; i < length; ++i){
+                    out(i) = std::sqrt(gx(i) * gx(i) + gy(i) * gy(i));
+                }
+                timer.lap(Stage::MAGNITUDE);
+                break;
+        }
+        // Count the column segment while it is still in cache
+        if(counts){
+            for(int i = 0; i < length; ++i){
+                int bin = static_cast<int>(std::abs(out(i)) / bin_width);
+                counts[std::min(bin, histogram_bins - 1)]++;
+            }
         }
     }
+    // Histogram counting is charged to the convolution
+    timer.lap(Stage::CONVOLUTION);
 }
 
-// Chooses and applies the kernel based on the detector type and gradient direction
-Eigen::MatrixXd EdgeDetector::kernel_detector(DetectorType detector_type, GradientType direction){
-    // Define kernels for X and Y directions
-    Eigen::MatrixXd Gx(3,3);
-    Eigen::MatrixXd Gy;
-    
-    // Placeholder for edge data
-    Eigen::MatrixXd edges(height, width);
+// Runs the column kernels over rows [row_begin, row_end) of the source through a view whose
+// first row is row_begin, so the rows land at the top of a band-sized tile
+template<typename Scalar>
+void BasicEdgeDetector<Scalar>::kernel_rows(Eigen::Ref<Matrix> tile, const Kernel& Gx, const Kernel& Gy, GradientType direction,
+                                            const PlaneView& source, int row_begin, int row_end) const {
+    PlaneView rows = source;
+    rows.origin = source.col(0) + row_begin;
+    rows.rows = row_end - row_begin;
+    kernel_processor(tile, Gx, Gy, direction, rows, 0, rows.rows);
+}
 
-    // Set up the kernels based on the detector type
+// Set up the X and Y kernels for the detector type
+template<typename Scalar>
+void BasicEdgeDetector<Scalar>::kernel_selector(DetectorType detector_type, Kernel& Gx, Kernel& Gy) const {
     switch (detector_type){
         case DetectorType::SOBEL: 
             // Sobel X and Y kernels
+            Gx.resize(3,3);
             Gx << -1, 0, 1,
                   -2, 0, 2,
                   -1, 0, 1;
@@ -179,6 +1290,7 @@ Eigen::MatrixXd EdgeDetector::kernel_detector(DetectorType detector_type, Gradie
             break;
         case DetectorType::PREWITT:
             // Prewitt X and Y kernels
+            Gx.resize(3,3);
             Gx << -1, 0, 1,
                   -1, 0, 1,
                   -1, 0, 1;
@@ -186,34 +1298,240 @@ Eigen::MatrixXd EdgeDetector::kernel_detector(DetectorType detector_type, Gradie
             break;
         case DetectorType::ROBERTSCROSS:
             // Roberts Cross kernels
-            Gx = Eigen::MatrixXd(2,2);
+            Gx.resize(2,2);
             Gx << 1, 0,
                   0, -1;
             Gy = Gx.rowwise().reverse().transpose(); // Reverse the rows and transpose for the Y kernel
             break;
+        case DetectorType::LOG:
+        case DetectorType::DOG:
+            // Second-derivative detectors use separable 1D kernels, see second_derivative_detector
+            break;
     }
-     
-    // Apply the kernel(s) based on the desired gradient direction
-    switch (direction)
-    {
-        case GradientType::X:
-            kernel_processor(edges, Gx); // Apply X kernel
+}
+
+// Chooses and applies the kernel based on the detector type and gradient direction
+template<typename Scalar>
+void BasicEdgeDetector<Scalar>::kernel_detector(Eigen::Ref<Matrix> edges, const PlaneView& source, DetectorType detector_type, GradientType direction,
+                                   Histogram* histogram) const {
+    // Define kernels for X and Y directions; fixed-capacity kernels live on the stack
+    Kernel Gx;
+    Kernel Gy;
+    kernel_selector(detector_type, Gx, Gy);
+
+    if(!histogram){
+        // Apply the kernel(s) to bands of rows in parallel; MAG combines X and Y per pixel
+        parallel_bands(0, source.rows, [&](int row_begin, int row_end){
+            kernel_processor(edges, Gx, Gy, direction, source, row_begin, row_end);
+        });
+        return;
+    }
+
+    // The largest possible response of an 8-bit input bounds the histogram range
+    double max_response = 255.0 * std::max(Gx.cwiseAbs().sum(), Gy.cwiseAbs().sum()) / 2.0;
+    if(direction == GradientType::MAG){
+        max_response *= std::sqrt(2.0);
+    }
+    // An empty histogram is started; a filled one, e.g. of the strips above, is added to
+    if(histogram->bins.empty()){
+        histogram->bins.assign(histogram_bins, 0);
+    }
+    histogram->bin_width = max_response / histogram_bins;
+
+    // Each band counts into the workspace of its thread, merged into the shared histogram when the band is done
+    std::mutex merge_mutex;
+    parallel_bands(0, source.rows, [&](int row_begin, int row_end){
+        std::uint64_t* local = Workspace::forThread().counters(COUNTS_SLOT, histogram_bins);
+        kernel_processor(edges, Gx, Gy, direction, source, row_begin, row_end, local, histogram->bin_width);
+        std::lock_guard<std::mutex> lock(merge_mutex);
+        for(int b = 0; b < histogram_bins; ++b){
+            histogram->bins[b] += local[b];
+        }
+    });
+}
+
+// Computes a LoG or DoG response with separable passes and returns its zero crossings
+template<typename Scalar>
+void BasicEdgeDetector<Scalar>::second_derivative_detector(Eigen::Ref<Matrix> edges, const Eigen::Ref<const Matrix>& source, DetectorType detector_type, GradientType direction,
+                                                           Histogram* histogram, int count_begin, int count_end) const {
+    // Sampled 1D Gaussian of the given scale, and optionally its second derivative, in workspace buffers
+    auto gaussian = [this](double s, int slot, int derivative_slot) -> Scratch {
+        int radius = static_cast<int>(std::ceil(3.0 * s));
+        Scratch g = Workspace::forThread().template matrix<Scalar>(slot, 2 * radius + 1, 1);
+        for(int k = -radius; k <= radius; ++k){
+            g(k + radius) = std::exp(-(k * k) / (2.0 * s * s));
+        }
+        g /= g.sum();
+        if(derivative_slot >= 0){
+            Scratch g2 = Workspace::forThread().template matrix<Scalar>(derivative_slot, g.size(), 1);
+            for(int k = -radius; k <= radius; ++k){
+                g2(k + radius) = (k * k / (s * s * s * s) - 1.0 / (s * s)) * g(k + radius);
+            }
+            // Force a zero sum so flat regions give no response
+            g2.array() -= g2.mean();
+        }
+        return g;
+    };
+
+    Scratch response = Workspace::forThread().template matrix<Scalar>(RESPONSE_SLOT, source.rows(), source.cols());
+    Scratch second = Workspace::forThread().template matrix<Scalar>(SECOND_RESPONSE_SLOT, source.rows(), source.cols());
+    // Largest possible response of an 8-bit input: both 2D kernels sum to zero, so a response
+    // is at most 255 times the sum of the positive weights, half the absolute sum
+    double max_response = 0.0;
+    switch(detector_type){
+        case DetectorType::LOG: {
+            // LoG = d2G/dx2 * G(y) + G(x) * d2G/dy2, each term separable
+            Scratch g = gaussian(sigma, KERNEL_SLOT, SECOND_KERNEL_SLOT);
+            int radius = static_cast<int>(g.size()) / 2;
+            Scratch g2 = Workspace::forThread().template matrix<Scalar>(SECOND_KERNEL_SLOT, 2 * radius + 1, 1);
+            separable_filter(response, source, g2.col(0), g.col(0));
+            separable_filter(second, source, g.col(0), g2.col(0));
+            response += second;
+            // g sums to 1, so each term has an absolute sum of at most that of g2
+            max_response = 255.0 * static_cast<double>(g2.cwiseAbs().sum());
             break;
-        case GradientType::Y:
-            kernel_processor(edges, Gy); // Apply Y kernel
+        }
+        case DetectorType::DOG: {
+            // DoG approximates the LoG with two blurs at scales sigma and 1.6 sigma
+            Scratch g1 = gaussian(sigma, KERNEL_SLOT, -1);
+            Scratch g2 = gaussian(1.6 * sigma, SECOND_KERNEL_SLOT, -1);
+            separable_filter(response, source, g1.col(0), g1.col(0));
+            separable_filter(second, source, g2.col(0), g2.col(0));
+            response -= second;
+            // Two blurs of absolute sum 1 each
+            max_response = 255.0;
             break;
-        case GradientType::MAG:
-            // For magnitude, apply both kernels and combine the results
-            Eigen::MatrixXd edges_x(height, width);
-            kernel_processor(edges_x, Gx); // Apply X kernel
+        }
+        default:
+            std::cerr << "Not a second-derivative detector" << std::endl;
+            edges.setZero();
+            return;
+    }
 
-            Eigen::MatrixXd edges_y(height, width);
-            kernel_processor(edges_y, Gy); // Apply Y kernel
+    if(histogram){
+        // A crossing joins two responses of opposite sign, so its strength is at most twice the largest.
+        // An empty histogram is started; a filled one, e.g. of the strips above, is added to
+        if(histogram->bins.empty()){
+            histogram->bins.assign(zero_crossing_bins, 0);
+        }
+        histogram->bin_width = 2.0 * max_response / zero_crossing_bins;
+    }
+    zero_crossings(edges, response, direction, histogram, count_begin, count_end);
+}
 
-            // Combine the X and Y gradients to get the edge magnitude
-            edges = (edges_x.array().square() + edges_y.array().square()).sqrt();
-            break;
+// Convolve every row with kx and then every column with ky, replicating the border pixels
+template<typename Scalar>
+void BasicEdgeDetector<Scalar>::separable_filter(Eigen::Ref<Matrix> out, const Eigen::Ref<const Matrix>& source,
+                                    const Eigen::Ref<const Vector>& kx, const Eigen::Ref<const Vector>& ky) const {
+    int rows = static_cast<int>(source.rows());
+    int cols = static_cast<int>(source.cols());
+    int rx = static_cast<int>(kx.size()) / 2;
+    int ry = static_cast<int>(ky.size()) / 2;
+
+    // Horizontal pass: each output column is a weighted sum of whole source columns
+    Scratch horizontal = Workspace::forThread().template matrix<Scalar>(FILTER_SLOT, rows, cols);
+    parallel_bands(0, cols, [&](int col_begin, int col_end){
+        StageScope timer(Stage::CONVOLUTION);
+        for(int j = col_begin; j < col_end; ++j){
+            horizontal.col(j).setZero();
+            for(int k = -rx; k <= rx; ++k){
+                int col = std::min(std::max(j + k, 0), cols - 1);
+                horizontal.col(j) += kx(k + rx) * source.col(col);
+            }
+        }
+    });
+
+    // Vertical pass: the interior of each output column is a weighted sum of shifted column
+    // segments, like the horizontal pass; only the clamped border rows are summed one by one
+    int interior = std::max(rows - 2 * ry, 0); // Rows whose taps all fall inside the image.
+    parallel_bands(0, cols, [&](int col_begin, int col_end){
+        StageScope timer(Stage::CONVOLUTION);
+        for(int j = col_begin; j < col_end; ++j){
+            if(interior > 0){
+                auto column = out.col(j).segment(ry, interior);
+                column = ky(0) * horizontal.col(j).segment(0, interior);
+                for(int k = 1; k <= 2 * ry; ++k){
+                    column += ky(k) * horizontal.col(j).segment(k, interior);
+                }
+            }
+            for(int i = 0; i < rows; ++i){
+                if(i >= ry && i < ry + interior){
+                    i = ry + interior - 1; // Skip the interior, done above.
+                    continue;
+                }
+                Scalar sum = 0;
+                for(int k = -ry; k <= ry; ++k){
+                    sum += ky(k + ry) * horizontal(std::min(std::max(i + k, 0), rows - 1), j);
+                }
+                out(i, j) = sum;
+            }
+        }
+    });
+}
+
+// Mark pixels where the response changes sign towards the next pixel; the strength is the size of the jump.
+// Bands of columns are finished one by one, so each band counts its strengths while they are in cache
+template<typename Scalar>
+void BasicEdgeDetector<Scalar>::zero_crossings(Eigen::Ref<Matrix> edges, const Eigen::Ref<const Matrix>& response, GradientType direction,
+                                               Histogram* histogram, int count_begin, int count_end) const {
+    int rows = static_cast<int>(response.rows());
+    int cols = static_cast<int>(response.cols());
+    if(rows < 2 || cols < 2){
+        edges.setZero();
+        if(histogram){
+            histogram->bins[0] += static_cast<std::uint64_t>(count_end - count_begin) * cols;
+        }
+        return;
     }
 
-    return edges;
+    std::mutex merge_mutex;
+    parallel_bands(0, cols, [&](int col_begin, int col_end){
+        std::uint64_t* local = nullptr;
+        {
+            StageScope timer(Stage::ZERO_CROSSINGS);
+            // Column array expressions so Eigen vectorizes the compare and select
+            for(int j = col_begin; j < col_end; ++j){
+                auto out = edges.col(j).array();
+                auto here = response.col(j).array();
+                auto top = here.head(rows - 1);
+                auto bottom = here.tail(rows - 1);
+                if(direction == GradientType::Y){
+                    out.head(rows - 1) = (top * bottom < 0.0).select((top - bottom).abs(), 0.0);
+                    out(rows - 1) = 0;
+                    continue;
+                }
+                // The last column has no right neighbour
+                if(j + 1 < cols){
+                    auto right = response.col(j + 1).array();
+                    out = (here * right < 0.0).select((here - right).abs(), 0.0);
+                } else {
+                    out.setZero();
+                }
+                if(direction == GradientType::MAG){
+                    // Keep the stronger of the horizontal and vertical crossings
+                    out.head(rows - 1) = out.head(rows - 1).max((top * bottom < 0.0).select((top - bottom).abs(), 0.0));
+                }
+            }
+            // Count the band while it is still in cache; counting is charged to the zero crossings
+            if(histogram){
+                local = Workspace::forThread().counters(COUNTS_SLOT, histogram->bins.size());
+                int last_bin = static_cast<int>(histogram->bins.size()) - 1;
+                for(int j = col_begin; j < col_end; ++j){
+                    for(int i = count_begin; i < count_end; ++i){
+                        local[std::min(static_cast<int>(edges(i, j) / histogram->bin_width), last_bin)]++;
+                    }
+                }
+            }
+        }
+        if(local){
+            std::lock_guard<std::mutex> lock(merge_mutex);
+            for(std::size_t b = 0; b < histogram->bins.size(); ++b){
+                histogram->bins[b] += local[b];
+            }
+        }
+    });
 }
+
+// Compile both precisions
+template class BasicEdgeDetector<double>;
+template class BasicEdgeDetector<float>;
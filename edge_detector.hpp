@@ -12,10 +12,23 @@
 #include <memory> // Memory management utilities.
 #include <cmath> // Standard math library.
 #include <functional> // Function objects and operations.
+#include <cstdint> // Fixed-width counters for histograms.
+#include <mutex> // Mutex for merging per-band results.
+#include <algorithm> // Min and max helpers.
+#include "padded_plane.hpp" // Aligned image planes with a border halo.
+#include "image_data.hpp" // Shared, immutable decoded images.
+#include "plane_stack.hpp" // Contiguous storage for multi-plane results such as pyramids.
+#include "thread_pool.hpp" // Shared worker pool and cancellation tokens.
+#include "parallel_backend.hpp" // parallel_for on the selected backend.
+#include "workspace.hpp" // Reusable scratch buffers.
+#include "stage_timer.hpp" // Per-stage timers of the pipeline.
+#include "trace.hpp" // Timeline tracing of stages, tasks and frames.
+#include "pixel_convert.hpp" // Vectorized de-interleave and grayscale weights.
+#include "bit_mask.hpp" // Bit-packed binary masks.
+#include "run_length_mask.hpp" // Run-length encoded binary masks.
 
-// EdgeDetector class defines an interface and implementation for detecting edges in images.
-// It supports multiple edge detection methods and can process both color and grayscale images.
-class EdgeDetector{
+// EdgeDetectorBase holds the enumerations shared by every precision of the detector.
+class EdgeDetectorBase{
 public:
     // Enumerations to specify the type and method of edge detection.
     enum class ImageType{
@@ -27,6 +40,8 @@ public:
         SOBEL,        // Use Sobel operator for edge detection.
         PREWITT,      // Use Prewitt operator for edge detection.
         ROBERTSCROSS, // Use Roberts Cross operator for edge detection.
+        LOG,          // Use zero crossings of the Laplacian of Gaussian.
+        DOG,          // Use zero crossings of the Difference of Gaussians.
     };
 
     enum class GradientType{
@@ -35,33 +50,213 @@ public:
         MAG,  // Calculate the magnitude of edges by combining X and Y directions.
     };
 
+    enum class ThresholdType{
+        OTSU,       // Threshold maximising the between-class variance of the magnitude histogram.
+        PERCENTILE, // Threshold at a given fraction of the magnitude distribution.
+    };
+
+    // How pixels outside the image are read by the kernels, see padded_plane.hpp.
+    using BorderPolicy = ::BorderPolicy;
+
+    // Binary mask type; edge pixels are 255 and background pixels 0.
+    using Mask = Eigen::Matrix<unsigned char, Eigen::Dynamic, Eigen::Dynamic>;
+};
+
+// BasicEdgeDetector class defines an interface and implementation for detecting edges in images.
+// It supports multiple edge detection methods and can process both color and grayscale images.
+// Scalar is the floating point type of every plane, kernel and output: EdgeDetector uses double,
+// EdgeDetectorF uses float for half the memory traffic and twice the SIMD width.
+// The image is immutable once loaded and every detection method is const and reentrant: scratch
+// buffers come from the calling thread's Workspace, so many threads can run detectors on one
+// instance at the same time. Loading and the setters must not run concurrently with detection.
+template<typename Scalar>
+class BasicEdgeDetector : public EdgeDetectorBase{
+public:
+    using Matrix = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>; // Image plane type.
+    using Vector = Eigen::Matrix<Scalar, Eigen::Dynamic, 1>; // 1D kernel type.
+    using PlaneStack = BasicPlaneStack<Scalar>; // Multi-plane result type.
+    using PaddedPlane = BasicPaddedPlane<Scalar>; // Image plane with a border halo.
+    using PlaneView = BasicPlaneView<Scalar>; // Non-owning view of a padded plane.
+    using ImageData = BasicImageData<Scalar>; // Decoded image shared between detectors.
+    using Scratch = Workspace::Scratch<Scalar>; // Matrix over a workspace buffer.
+
+    // Result of a detector run with automatic thresholding.
+    struct ThresholdResult{
+        Matrix edges; // Raw detector output.
+        double threshold = 0.0; // Threshold picked from the magnitude histogram.
+        Mask mask; // Binary mask, only filled when requested.
+    };
+
+    // Result of colour edge detection via the structure tensor.
+    struct ColorGradient{
+        Matrix magnitude; // Square root of the largest structure tensor eigenvalue.
+        Matrix direction; // Orientation of the dominant eigenvector, in radians.
+    };
+
+    // Edge pixels as a structure of arrays, ordered by row and then column.
+    struct EdgeList{
+        std::vector<int> x; // Column of each edge pixel.
+        std::vector<int> y; // Row of each edge pixel.
+        std::vector<Scalar> magnitude; // Gradient magnitude (zero-crossing strength for LoG and DoG).
+        std::vector<Scalar> orientation; // Gradient angle in radians, empty unless requested.
+        std::size_t size() const { return x.size(); } // Number of edge pixels.
+    };
+
+    // Memory used by the last dense applyDetector call.
+    struct MemoryStats{
+        std::size_t image_bytes = 0; // Decoded input planes.
+        std::size_t output_bytes = 0; // Edge map written by the call.
+        std::size_t scratch_bytes = 0; // Largest set of temporaries live at the same time.
+        std::size_t peak_bytes = 0; // Sum of the above.
+        int strips = 1; // Number of strips the image was split into, 1 when it was processed whole.
+    };
+
     // Constructors and destructors.
-    EdgeDetector() = default; // Default constructor.
-    ~EdgeDetector() = default; // Default destructor.
+    BasicEdgeDetector() = default; // Default constructor.
+    ~BasicEdgeDetector() = default; // Default destructor.
 
     // Public interface methods.
     bool loadImage(std::string filename); // Loads an image from the specified file.
-    Eigen::MatrixXd applyDetector(DetectorType detector_type, GradientType direction); // Applies the selected edge detection algorithm.
-    bool saveImage(std::string filename, ImageType image_type = ImageType::COLOR); // Saves the processed image to a file.
-    bool saveEdgeImage(std::string filename, Eigen::MatrixXd Edges); // Saves the edge-detected image.
+    std::shared_ptr<const ImageData> getImage() const { return in_image; } // The loaded image, for sharing with other detectors.
+    bool setImage(std::shared_ptr<const ImageData> image); // Uses an already decoded image without copying it.
+    bool fillImage(ImageData& image, const unsigned char* pixels, int width, int height,
+                   int channels) const; // Decodes interleaved 8-bit pixels into an image, e.g. a frame ring slot, ready for setImage.
+    Matrix applyDetector(DetectorType detector_type, GradientType direction) const; // Applies the selected edge detection algorithm.
+    bool applyDetector(DetectorType detector_type, GradientType direction, Matrix& edges) const; // Same, reusing the caller's output matrix.
+    bool applyDetectorHalfScale(DetectorType detector_type, GradientType direction, Matrix& edges) const; // Detects on the image halved in each direction, about 4x cheaper, at full output size.
+    std::vector<Matrix> applyDetectorBatch(const std::vector<std::shared_ptr<const ImageData>>& images, DetectorType detector_type,
+                                           GradientType direction) const; // Applies the detector to every image, one pool task per image.
+    std::vector<Matrix> applyDetectorBatch(const std::vector<std::string>& filenames, DetectorType detector_type,
+                                           GradientType direction) const; // Same, loading every file inside its task.
+    ThresholdResult applyDetector(DetectorType detector_type, GradientType direction, ThresholdType threshold_type,
+                                  double percentile = 0.9, bool emit_mask = false) const; // Applies a detector and picks a threshold in the same pass.
+    bool applyDetector(DetectorType detector_type, GradientType direction, ThresholdType threshold_type, ThresholdResult& result,
+                       double percentile = 0.9, bool emit_mask = false) const; // Same, reusing the buffers of a previous result.
+    BitMask applyDetectorMask(DetectorType detector_type, GradientType direction, double threshold) const; // Applies a detector and packs |edges| > threshold into bits.
+    RunLengthMask applyDetectorRLE(DetectorType detector_type, GradientType direction, double threshold) const; // Applies a detector and run-length encodes |edges| > threshold.
+    // Lists pixels whose magnitude exceeds the threshold. Gradient detectors never hold more than
+    // a band of responses. LoG and DoG hold the response of one strip of up to sparse_strip_rows
+    // rows plus its filter margins, or fewer rows under a memory budget, not of the whole image.
+    EdgeList applyDetectorSparse(DetectorType detector_type, double threshold, bool with_orientation = false) const;
+    ColorGradient applyColorDetector(DetectorType detector_type) const; // Detects colour edges with the Di Zenzo structure tensor.
+    PlaneStack applyDetectorPerChannel(DetectorType detector_type, GradientType direction) const; // Applies the detector to every channel of the image.
+    PlaneStack applyDetectorPyramid(DetectorType detector_type, GradientType direction, int levels,
+                                    PlaneStack* pyramid = nullptr) const; // Applies the detector to every level of a Gaussian pyramid, optionally returning the levels.
+    void setSigma(double sigma){ this->sigma = sigma; } // Sets the Gaussian scale used by the LoG and DoG detectors.
+    void setBorderPolicy(BorderPolicy policy, double constant = 0.0); // Sets how the kernels read pixels outside the image.
+    bool saveImage(std::string filename, ImageType image_type = ImageType::COLOR) const; // Saves the processed image to a file.
+    bool saveEdgeImage(std::string filename, const Matrix& Edges) const; // Saves the edge-detected image.
+    void setCancellation(CancellationToken token){ cancellation = std::move(token); } // Stops detection between row bands once the token is cancelled.
+    bool cancelled() const { return cancellation.isCancelled(); } // True once the detector's token was cancelled.
+    void setMemoryBudget(std::size_t bytes){ memory_budget = bytes; } // Caps the memory of a detector call, 0 for no limit.
+    void setNodePools(bool enabled){ node_pools = enabled; } // Splits batches over one pinned pool per NUMA node (pool backend only).
+    const MemoryStats& getMemoryStats() const; // Memory used by the calling thread's last dense applyDetector call.
+    const StageStats& getStageStats() const { return StageCall::last(); } // Stage times of the calling thread's last load, fill, applyDetector or save call.
+    Workspace& getWorkspace() const { return Workspace::forThread(); } // The calling thread's scratch buffers and their allocation counters.
 
 private:
     // Private member variables for image dimensions and storage.
     int width; // Image width.
     int height; // Image height.
     int channels; // Number of color channels in the image.
-    std::vector<Eigen::MatrixXd> in_image; // Vector of matrices to store the original image channels.
-    Eigen::MatrixXd gray_image; // Matrix to store the grayscale version of the image.
+    std::shared_ptr<const ImageData> in_image; // Original image channels, possibly shared with other detectors.
+    std::shared_ptr<ImageData> own_image; // Writable handle to in_image when this detector created it, else null.
+    double sigma = 1.4; // Gaussian scale used by the LoG and DoG detectors.
+    BorderPolicy border_policy = BorderPolicy::REPLICATE; // How the halo of every plane is filled.
+    Scalar border_constant = 0; // Halo value for the constant border policy.
+    static constexpr int halo = 1; // Halo width; enough for the 3x3 gradient kernels.
+    static constexpr int pyramid_halo = 2; // Halo of the pyramid levels; enough for the 5-tap binomial kernel.
+    std::size_t memory_budget = 0; // Memory limit of a detector call in bytes, 0 for no limit.
+    bool node_pools = false; // Batches run on the NUMA node pools instead of the current pool.
+    CancellationToken cancellation; // Checked before every row band; a cancelled call returns false.
+    static thread_local MemoryStats memory_stats; // Memory used by the last dense applyDetector call on each thread.
+
+    // Workspace slots for the temporaries of each pass.
+    enum WorkspaceSlot{
+        RESPONSE_SLOT,        // Second-derivative response.
+        SECOND_RESPONSE_SLOT, // Second term of the LoG, or the wide blur of the DoG.
+        FILTER_SLOT,          // Horizontal pass of the separable filter.
+        KERNEL_SLOT,          // First 1D kernel.
+        SECOND_KERNEL_SLOT,   // Second 1D kernel.
+        SAVE_SLOT,            // Interleaved bytes handed to the PNG writer.
+        MASK_SLOT,            // Dense output packed into a bit mask.
+        STRIP_SLOT,           // Zero crossings of one strip, margin rows included.
+        UNPACK_SLOT,          // De-interleaved bytes of one tile while loading.
+        HALF_SLOT,            // Edge map of the half-scale image.
+        BAND_SLOT,            // Values of one row or column band, in the workspace of the thread running it.
+        COUNTS_SLOT,          // Histogram counts of one band.
+        TILE_SLOT,            // Detector output of a few rows of a band, before they are handed out as rows.
+        SECOND_TILE_SLOT,     // Y responses of the rows of a sparse band.
+        ROW_SLOT,             // One output row, contiguous for a row consumer.
+        PYRAMID_SLOT,         // Horizontal pass of one pyramid column.
+    };
+
+    // Workspace slots for padded planes.
+    enum PlaneSlot{
+        GRAY_PLANE,  // Grayscale image, when it was not kept at load.
+        STRIP_PLANE, // Grayscale rows of the current strip when tiling.
+        HALF_PLANE,  // Grayscale image averaged over 2x2 blocks.
+    };
+
+    // Gradient kernels are at most 3x3, so they never need the heap.
+    using Kernel = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, 0, 3, 3>;
+
+    // Histogram of absolute edge values, filled while the detector runs.
+    struct Histogram{
+        std::vector<std::uint64_t> bins; // Pixel count per bin.
+        double bin_width = 1.0; // Value range covered by each bin.
+    };
+    static constexpr int tile_rows = 64; // Rows computed together when streaming rows: column segments long enough for the vector kernels.
+    static constexpr int sparse_strip_rows = 256; // Rows per strip of a sparse LoG/DoG run; a multiple of its 16-row bands.
+    static constexpr int histogram_bins = 1024; // Number of bins used for automatic thresholding.
+    static constexpr int zero_crossing_bins = 4 * histogram_bins; // Finer bins for LoG and DoG, whose a priori range is wider than the strengths seen in practice.
 
     // Private methods for edge detection algorithms.
-    Eigen::MatrixXd sobel(GradientType direction); // Implements the Sobel edge detection.
-    Eigen::MatrixXd prewitt(GradientType direction); // Implements the Prewitt edge detection.
-    void kernel_processor(Eigen::MatrixXd& edges, Eigen::MatrixXd kernel); // Applies a convolution kernel to detect edges.
-    Eigen::MatrixXd kernel_detector(DetectorType detector_type, GradientType direction); // Detects edges using specified kernel and gradient type.
+    Matrix sobel(GradientType direction); // Implements the Sobel edge detection.
+    Matrix prewitt(GradientType direction); // Implements the Prewitt edge detection.
+    void kernel_selector(DetectorType detector_type, Kernel& Gx, Kernel& Gy) const; // Sets up the X and Y kernels of a detector.
+    void kernel_processor(Eigen::Ref<Matrix> edges, const Kernel& Gx, const Kernel& Gy, GradientType direction,
+                          const PlaneView& source, int row_begin, int row_end,
+                          std::uint64_t* counts = nullptr, double bin_width = 1.0) const; // Applies the kernels to a band of rows, optionally counting values into histogram_bins counts.
+    void detector_rows(const PaddedPlane& gray, DetectorType detector_type, GradientType direction,
+                       FunctionRef<void(int, const Scalar*)> consume) const; // Streams detector output rows to a consumer in parallel.
+    void kernel_rows(Eigen::Ref<Matrix> tile, const Kernel& Gx, const Kernel& Gy, GradientType direction,
+                     const PlaneView& source, int row_begin, int row_end) const; // Applies the kernels to a few rows, written to the top rows of a tile.
+    void kernel_detector(Eigen::Ref<Matrix> edges, const PlaneView& source, DetectorType detector_type, GradientType direction,
+                         Histogram* histogram = nullptr) const; // Detects edges using specified kernel and gradient type.
+    int plan_strips(DetectorType detector_type) const; // Rows per strip that keep a call within the memory budget.
+    int strip_margin(DetectorType detector_type) const; // Rows of context a strip needs on each side.
+    bool strip_detector(Eigen::Ref<Matrix> edges, DetectorType detector_type, GradientType direction, int rows_per_strip,
+                        Histogram* histogram = nullptr) const; // Runs a detector strip by strip with the same result as a whole-image run.
+    void record_memory(std::size_t scratch_bytes, int strips) const; // Updates the memory statistics of the last call.
+    void trim_workspace() const; // Gives back workspace buffers beyond the budget after a budgeted call.
+    double histogram_threshold(const Histogram& histogram, ThresholdType threshold_type, double percentile) const; // Picks a threshold from a histogram.
+    void second_derivative_detector(Eigen::Ref<Matrix> edges, const Eigen::Ref<const Matrix>& source, DetectorType detector_type, GradientType direction,
+                                    Histogram* histogram = nullptr, int count_begin = 0, int count_end = 0) const; // Detects zero crossings of LoG or DoG, optionally counting rows [count_begin, count_end).
+    void separable_filter(Eigen::Ref<Matrix> out, const Eigen::Ref<const Matrix>& source,
+                          const Eigen::Ref<const Vector>& kx, const Eigen::Ref<const Vector>& ky) const; // Convolves rows with kx, then columns with ky.
+    void zero_crossings(Eigen::Ref<Matrix> edges, const Eigen::Ref<const Matrix>& response, GradientType direction,
+                        Histogram* histogram = nullptr, int count_begin = 0, int count_end = 0) const; // Marks sign changes of a second-derivative response, counting rows [count_begin, count_end) into the histogram.
+    void pyramid_downsample(Eigen::Ref<Matrix> level, const PlaneView& source, int row_begin, int row_end) const; // Blurs and decimates a band of rows into the next pyramid level.
+
+    void parallel_bands(int begin, int end, FunctionRef<void(int, int)> body,
+                        int grain = 0) const; // parallel_for that skips the remaining bands once the call is cancelled.
+    void batch_items(int n_items, FunctionRef<void(int)> item) const; // Runs one task per batch item, on the node pools if enabled.
+    ImageData& writable_image(bool keep_contents); // The image, copied first if another owner shares it.
+    bool has_image() const; // Reports an error unless an image is loaded.
+    const PaddedPlane* grayscale() const; // The grayscale plane, converted into thread scratch if the image has none.
 
     // Utility method to convert an image to grayscale.
-    bool convertToGrayscale(); // Converts the loaded image to grayscale, facilitating edge detection on color images.
+    bool convertToGrayscale(Eigen::Ref<Matrix> gray, int row_begin = 0) const; // Writes grayscale rows from row_begin on into caller-provided storage.
+    bool convertToGrayscale(const ImageData& image, Eigen::Ref<Matrix> gray, int row_begin = 0) const; // Same, for any image.
 
 };
 
+using EdgeDetector = BasicEdgeDetector<double>; // Double precision detector.
+using EdgeDetectorF = BasicEdgeDetector<float>; // Single precision detector.
+
+// Both precisions are compiled once, in edge_detector.cpp.
+extern template class BasicEdgeDetector<double>;
+extern template class BasicEdgeDetector<float>;
+
 #endif // EDGE_DETECTOR_HPP
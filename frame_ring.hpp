@@ -0,0 +1,279 @@
+#ifndef FRAME_RING_HPP
+#define FRAME_RING_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <vector> // Standard vector class for the slots and index rings.
+#include <memory> // Shared pointers handed to the detectors.
+#include <atomic> // Lock-free ring indices and counters.
+#include <thread> // Yielding while a blocking call spins.
+#include <mutex> // Parking without C++20 atomic waits.
+#include <condition_variable> // Same.
+#include <cstdint> // Fixed-width counters.
+#include <cstddef> // Size type for occupancy.
+#include "image_data.hpp" // Decoded frames stored in the slots.
+#include "trace.hpp" // Waits on a full or empty ring, when tracing.
+
+// What the producer does when the ring already holds capacity frames.
+enum class FramePolicy{
+    DROP_OLDEST, // Discard the oldest unread frame; capture never waits.
+    BLOCK,       // Wait until the consumer has read a frame.
+};
+
+// BasicFrameRing passes frames from one capture thread to one detection thread without locks.
+// Every frame lives in one of capacity + 2 preallocated slots: one being written, up to
+// capacity ready to read and one being read. The producer fills a slot in place (e.g. with
+// EdgeDetector::fillImage) and commits it; the consumer gets the slot as a shared pointer it
+// can hand to EdgeDetector::setImage, so no frame is copied. Slot indices move between a
+// ready ring and a free ring; the ready ring is popped with a compare-and-swap so that the
+// producer can take back the oldest frame under the drop-oldest policy. A thread that has to
+// wait spins briefly, then sleeps until the other side moves a frame, so a stalled consumer
+// or producer does not keep a core busy.
+template<typename Scalar>
+class BasicFrameRing{
+public:
+    using ImageData = BasicImageData<Scalar>; // Frame type.
+
+    // Constructors and destructors.
+    // Preallocates every slot for frames of the given size; halo must match the detector's (1).
+    BasicFrameRing(int capacity, int width, int height, int channels, FramePolicy policy = FramePolicy::DROP_OLDEST, int halo = 1)
+        : capacity(capacity < 1 ? 1 : capacity), policy(policy), ready(this->capacity + 2), free_slots(this->capacity + 2){
+        int n_slots = this->capacity + 2;
+        for(int s = 0; s < n_slots; ++s){
+            auto frame = std::make_shared<ImageData>();
+            frame->width = width;
+            frame->height = height;
+            frame->channels = channels;
+            frame->planes.resize(channels);
+            for(auto& plane : frame->planes){
+                plane.reshape(height, width, halo);
+            }
+            frame->gray.reshape(height, width, halo);
+            slots.push_back(std::move(frame));
+        }
+        // The producer starts with slot 0, every other slot is free
+        writing = 0;
+        for(int s = 1; s < n_slots; ++s){
+            free_slots.push(s);
+        }
+    }
+
+    BasicFrameRing(const BasicFrameRing&) = delete;
+    BasicFrameRing& operator=(const BasicFrameRing&) = delete;
+
+    // Producer side.
+    // The slot to fill next. It stays the same until commit() is called.
+    ImageData& frame(){ return *slots[writing]; }
+
+    // Publishes the filled slot. Under DROP_OLDEST a full ring drops its oldest frame and
+    // commit() never waits; under BLOCK it waits for the consumer. Returns false when closed.
+    bool commit(){
+        std::uint64_t blocked = 0; // Timer when a traced producer started waiting.
+        int spins = 0; // Checks so far while blocked.
+        while(true){
+            // Read before the checks, so a frame read after them ends the wait at once
+            std::uint32_t seen = consumer_moved.epoch();
+            if(ready.size() < static_cast<std::size_t>(capacity)){
+                break;
+            }
+            if(closed.load(std::memory_order_acquire)){
+                return false;
+            }
+            if(policy == FramePolicy::DROP_OLDEST){
+                int oldest;
+                if(ready.pop(oldest)){
+                    // The dropped slot is written next instead of going through the free ring
+                    spare = oldest;
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+                continue;
+            }
+            if(!blocked && tracingEnabled()){
+                blocked = readTicks();
+            }
+            pause(spins, consumer_moved, seen);
+        }
+        if(blocked){
+            traceEvent("ring full", "ring", blocked, readTicks(), static_cast<std::int64_t>(committedCount()));
+        }
+        ready.push(writing);
+        committed.fetch_add(1, std::memory_order_relaxed);
+        producer_moved.notify();
+
+        // Take the next slot to write; one is always free or about to be released
+        if(spare >= 0){
+            writing = spare;
+            spare = -1;
+        } else {
+            spins = 0;
+            while(true){
+                std::uint32_t seen = consumer_moved.epoch();
+                if(free_slots.pop(writing)){
+                    break;
+                }
+                pause(spins, consumer_moved, seen);
+            }
+        }
+        return true;
+    }
+
+    // Tells the consumer no more frames will come; read() returns null once the ring is empty.
+    void close(){
+        closed.store(true, std::memory_order_release);
+        producer_moved.notify();
+        consumer_moved.notify();
+    }
+
+    // Consumer side.
+    // The oldest unread frame, or null if there is none. The frame read before is released,
+    // so the consumer must be done with it, and detectors must not use it afterwards.
+    std::shared_ptr<const ImageData> tryRead(){
+        release();
+        int slot;
+        if(!ready.pop(slot)){
+            return nullptr;
+        }
+        reading = slot;
+        consumed.fetch_add(1, std::memory_order_relaxed);
+        consumer_moved.notify();
+        return slots[slot];
+    }
+
+    // Waits for the next frame; returns null when the ring is closed and empty.
+    std::shared_ptr<const ImageData> read(){
+        std::uint64_t starved = 0; // Timer when a traced consumer started waiting.
+        int spins = 0; // Checks so far.
+        while(true){
+            // Read before the checks, so a frame committed after them ends the wait at once
+            std::uint32_t seen = producer_moved.epoch();
+            auto frame = tryRead();
+            if(frame || (closed.load(std::memory_order_acquire) && ready.size() == 0)){
+                if(starved){
+                    traceEvent("ring empty", "ring", starved, readTicks(), static_cast<std::int64_t>(consumedCount()));
+                }
+                return frame;
+            }
+            if(!starved && tracingEnabled()){
+                starved = readTicks();
+            }
+            pause(spins, producer_moved, seen);
+        }
+    }
+
+    // Returns the frame being read to the producer.
+    void release(){
+        if(reading >= 0){
+            free_slots.push(reading);
+            reading = -1;
+            consumer_moved.notify();
+        }
+    }
+
+    // Counters, safe to read from any thread.
+    std::size_t occupancy() const { return ready.size(); } // Frames ready to read.
+    std::uint64_t committedCount() const { return committed.load(std::memory_order_relaxed); } // Frames published by the producer.
+    std::uint64_t consumedCount() const { return consumed.load(std::memory_order_relaxed); } // Frames read by the consumer.
+    std::uint64_t droppedCount() const { return dropped.load(std::memory_order_relaxed); } // Frames discarded unread.
+    int size() const { return capacity; } // Maximum number of frames ready to read.
+
+private:
+    // Ring of slot indices. Only one thread pushes; pops use a compare-and-swap on the head,
+    // which is a 64-bit counter, so concurrent pops by the producer and consumer stay safe.
+    class IndexRing{
+    public:
+        explicit IndexRing(int n) : entries(n){}
+        void push(int value){
+            std::uint64_t t = tail.load(std::memory_order_relaxed);
+            entries[t % entries.size()].store(value, std::memory_order_relaxed);
+            tail.store(t + 1, std::memory_order_release);
+        }
+        bool pop(int& value){
+            std::uint64_t h = head.load(std::memory_order_acquire);
+            while(h != tail.load(std::memory_order_acquire)){
+                value = entries[h % entries.size()].load(std::memory_order_relaxed);
+                if(head.compare_exchange_weak(h, h + 1, std::memory_order_acq_rel, std::memory_order_acquire)){
+                    return true;
+                }
+            }
+            return false;
+        }
+        std::size_t size() const {
+            std::uint64_t h = head.load(std::memory_order_acquire);
+            return static_cast<std::size_t>(tail.load(std::memory_order_acquire) - h);
+        }
+    private:
+        std::vector<std::atomic<int>> entries; // Slot indices; each ring holds at most all slots.
+        alignas(64) std::atomic<std::uint64_t> head{0}; // Next entry to pop.
+        alignas(64) std::atomic<std::uint64_t> tail{0}; // Next entry to push.
+    };
+
+    // Counts the moves of one side, so the other can sleep until the next one. A waiter reads
+    // epoch(), checks its condition and calls wait() with what it read, which returns once the
+    // count has moved on. C++20 builds use std::atomic::wait; otherwise a condition variable,
+    // which notify() only touches when a thread sleeps on it.
+    class EventCount{
+    public:
+        std::uint32_t epoch() const { return count.load(std::memory_order_seq_cst); }
+        void notify(){
+            count.fetch_add(1, std::memory_order_seq_cst);
+#if defined(__cpp_lib_atomic_wait)
+            count.notify_all();
+#else
+            if(sleepers.load(std::memory_order_seq_cst) > 0){
+                // Taking the lock orders the count before a sleeper's check of it
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                }
+                wake.notify_all();
+            }
+#endif
+        }
+        void wait(std::uint32_t seen){
+#if defined(__cpp_lib_atomic_wait)
+            count.wait(seen, std::memory_order_seq_cst);
+#else
+            std::unique_lock<std::mutex> lock(mutex);
+            sleepers.fetch_add(1, std::memory_order_seq_cst);
+            wake.wait(lock, [&]{ return count.load(std::memory_order_seq_cst) != seen; });
+            sleepers.fetch_sub(1, std::memory_order_seq_cst);
+#endif
+        }
+    private:
+        std::atomic<std::uint32_t> count{0}; // Moves so far, wrapping.
+#if !defined(__cpp_lib_atomic_wait)
+        std::atomic<int> sleepers{0}; // Threads in wait().
+        std::mutex mutex; // Guards the sleep and wake handshake.
+        std::condition_variable wake; // Signalled on every move while a thread sleeps.
+#endif
+    };
+
+    static constexpr int spin_limit = 64; // Yields before a waiting thread goes to sleep.
+
+    // One step of a wait: yield for the first spin_limit steps, then sleep until the other side moves.
+    static void pause(int& spins, EventCount& moves, std::uint32_t seen){
+        if(spins < spin_limit){
+            ++spins;
+            std::this_thread::yield();
+        } else {
+            moves.wait(seen);
+        }
+    }
+
+    int capacity; // Maximum number of frames ready to read.
+    FramePolicy policy; // What a full ring does on commit.
+    std::vector<std::shared_ptr<ImageData>> slots; // Preallocated frames.
+    IndexRing ready; // Committed frames, oldest first; pushed by the producer.
+    IndexRing free_slots; // Released frames; pushed by the consumer, popped by the producer.
+    int writing = -1; // Slot owned by the producer.
+    int spare = -1; // Slot the producer took back by dropping it.
+    int reading = -1; // Slot owned by the consumer.
+    std::atomic<bool> closed{false}; // Set when the producer has finished.
+    EventCount producer_moved; // Frames committed, and the close.
+    EventCount consumer_moved; // Frames read or released.
+    alignas(64) std::atomic<std::uint64_t> committed{0}; // Frames published.
+    alignas(64) std::atomic<std::uint64_t> consumed{0}; // Frames read.
+    std::atomic<std::uint64_t> dropped{0}; // Frames discarded unread.
+};
+
+using FrameRing = BasicFrameRing<double>; // Double precision frames.
+
+#endif // FRAME_RING_HPP
@@ -0,0 +1,32 @@
+#ifndef FUNCTION_REF_HPP
+#define FUNCTION_REF_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <memory> // std::addressof for the referenced callable.
+#include <type_traits> // Excluding FunctionRef itself from the converting constructor.
+#include <utility> // Forwarding the call arguments.
+
+template<typename Signature>
+class FunctionRef;
+
+// FunctionRef refers to a callable without owning or copying it, so passing a lambda with
+// many captures never allocates, unlike std::function. The callable must outlive every call,
+// which holds for loop bodies: parallel_for returns only once the body has run on every chunk.
+template<typename Result, typename... Args>
+class FunctionRef<Result(Args...)>{
+public:
+    template<typename Callable, typename = std::enable_if_t<!std::is_same<std::decay_t<Callable>, FunctionRef>::value>>
+    FunctionRef(Callable&& callable)
+        : object(const_cast<void*>(static_cast<const void*>(std::addressof(callable)))),
+          call([](void* object, Args... args) -> Result {
+              return (*static_cast<std::add_pointer_t<Callable>>(object))(std::forward<Args>(args)...);
+          }){}
+
+    Result operator()(Args... args) const { return call(object, std::forward<Args>(args)...); } // Calls the referenced callable.
+
+private:
+    void* object; // The callable.
+    Result (*call)(void*, Args...); // Calls object with its real type.
+};
+
+#endif // FUNCTION_REF_HPP
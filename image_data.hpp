@@ -0,0 +1,53 @@
+#ifndef IMAGE_DATA_HPP
+#define IMAGE_DATA_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <vector> // Standard vector class for the channel planes.
+#include <cstddef> // Size type for byte counts.
+#include "padded_plane.hpp" // Aligned image planes with a border halo.
+
+// BasicImageData holds one decoded image: a padded plane per channel with its halo filled.
+// Detectors hand it around as std::shared_ptr<const BasicImageData>, so one decoded frame can
+// be read by any number of detectors and threads at once. The grayscale plane is converted
+// once at load, so detection never writes to the image. A detector only writes to an image
+// it holds the sole reference to, and copies it first otherwise (copy-on-write).
+template<typename Scalar>
+struct BasicImageData{
+    using PaddedPlane = BasicPaddedPlane<Scalar>; // Channel plane type.
+
+    int width = 0; // Image width.
+    int height = 0; // Image height.
+    int channels = 0; // Number of color channels.
+    std::vector<PaddedPlane> planes; // One padded plane per channel.
+    PaddedPlane gray; // Grayscale plane, empty when it was not kept at load.
+    BorderPolicy border_policy = BorderPolicy::REPLICATE; // Policy the halos were filled with.
+    Scalar border_constant = 0; // Halo value for the constant border policy.
+
+    // Refills the halo of every plane.
+    void fillBorders(BorderPolicy policy, Scalar constant){
+        border_policy = policy;
+        border_constant = constant;
+        for(auto& plane : planes){
+            plane.view().fillBorder(policy, constant);
+        }
+        gray.view().fillBorder(policy, constant);
+    }
+
+    // True when the halos were filled with the given policy.
+    bool hasBorder(BorderPolicy policy, Scalar constant) const {
+        return border_policy == policy && (policy != BorderPolicy::CONSTANT || border_constant == constant);
+    }
+
+    // Size of the pixel storage, halos included.
+    std::size_t bytes() const {
+        std::size_t total = 0;
+        for(const auto& plane : planes){
+            total += plane.bytes();
+        }
+        return total + gray.bytes();
+    }
+};
+
+using ImageData = BasicImageData<double>; // Double precision image.
+
+#endif // IMAGE_DATA_HPP
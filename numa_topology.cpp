@@ -0,0 +1,131 @@
+#include "numa_topology.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace {
+// CPUs the process is allowed to run on; empty when unknown
+std::vector<int> allowed_cpus(){
+    std::vector<int> cpus;
+#if defined(__linux__)
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if(sched_getaffinity(0, sizeof(mask), &mask) == 0){
+        for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu){
+            if(CPU_ISSET(cpu, &mask)){
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    return cpus;
+}
+
+// One node per nodeN directory, in node order, keeping the allowed CPUs
+NumaTopology read_topology(){
+    NumaTopology topology;
+    std::vector<int> allowed = allowed_cpus();
+    std::vector<std::pair<int, std::vector<int>>> found;
+    std::error_code error;
+    for(const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)){
+        std::string name = entry.path().filename().string();
+        if(name.size() <= 4 || name.compare(0, 4, "node") != 0 || !std::all_of(name.begin() + 4, name.end(), [](char c){ return std::isdigit(static_cast<unsigned char>(c)); })){
+            continue;
+        }
+        std::ifstream file(entry.path() / "cpulist");
+        std::string list;
+        std::getline(file, list);
+        std::vector<int> cpus;
+        for(int cpu : parseCpuList(list)){
+            if(allowed.empty() || std::binary_search(allowed.begin(), allowed.end(), cpu)){
+                cpus.push_back(cpu);
+            }
+        }
+        // Memory-only nodes have no CPUs to run a pool on
+        if(!cpus.empty()){
+            found.emplace_back(std::stoi(name.substr(4)), std::move(cpus));
+        }
+    }
+    std::sort(found.begin(), found.end());
+    for(auto& node : found){
+        topology.ids.push_back(node.first);
+        topology.nodes.push_back(std::move(node.second));
+    }
+
+    // No NUMA information: a single node 0 with every CPU
+    if(topology.nodes.empty()){
+        if(allowed.empty()){
+            for(unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu){
+                allowed.push_back(static_cast<int>(cpu));
+            }
+        }
+        topology.ids.push_back(0);
+        topology.nodes.push_back(allowed);
+    }
+    return topology;
+}
+}
+
+// The topology does not change while the process runs
+const NumaTopology& NumaTopology::system(){
+    static const NumaTopology topology = read_topology();
+    return topology;
+}
+
+// The ids are sorted
+int NumaTopology::indexOf(int node) const {
+    auto it = std::lower_bound(ids.begin(), ids.end(), node);
+    return it != ids.end() && *it == node ? static_cast<int>(it - ids.begin()) : -1;
+}
+
+// Search every node's list
+int NumaTopology::nodeOfCpu(int cpu) const {
+    for(int index = 0; index < size(); ++index){
+        if(std::binary_search(nodes[index].begin(), nodes[index].end(), cpu)){
+            return ids[index];
+        }
+    }
+    return -1;
+}
+
+// Node by node, so consecutive entries share a node
+std::vector<int> NumaTopology::cpus() const {
+    std::vector<int> all;
+    for(const auto& node : nodes){
+        all.insert(all.end(), node.begin(), node.end());
+    }
+    return all;
+}
+
+// Comma-separated CPU numbers and inclusive ranges; malformed entries are skipped
+std::vector<int> parseCpuList(const std::string& list){
+    std::vector<int> cpus;
+    std::stringstream stream(list);
+    std::string item;
+    while(std::getline(stream, item, ',')){
+        int first, last;
+        char dash;
+        std::stringstream range(item);
+        if(!(range >> first)){
+            continue;
+        }
+        last = first;
+        if(range >> dash && dash == '-' && !(range >> last)){
+            continue;
+        }
+        for(int cpu = first; cpu <= last; ++cpu){
+            cpus.push_back(cpu);
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
@@ -0,0 +1,31 @@
+#ifndef NUMA_TOPOLOGY_HPP
+#define NUMA_TOPOLOGY_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <vector> // CPU lists of the nodes.
+#include <string> // Kernel CPU list strings.
+
+// NumaTopology lists the CPUs of every NUMA node, read from /sys/devices/system/node. Only
+// CPUs the process may run on are listed, so nodes outside its affinity mask (e.g. under
+// taskset or a cgroup) are left out. Where the information is not available the machine is
+// one node with every CPU.
+//
+// Nodes are identified by their kernel number (the N of nodeN), which need not be dense: a
+// node may have been left out, or the machine may number its nodes 0 and 2. nodes and ids
+// are indexed alike, in ascending node order.
+struct NumaTopology{
+    std::vector<std::vector<int>> nodes; // CPUs of each listed node, ascending; never empty.
+    std::vector<int> ids; // Kernel node number of each entry of nodes, ascending.
+
+    static const NumaTopology& system(); // Topology of this machine, read on first use.
+
+    int size() const { return static_cast<int>(nodes.size()); } // Number of listed nodes.
+    int indexOf(int node) const; // Index in nodes of a kernel node number, -1 if it is not listed.
+    int nodeOfCpu(int cpu) const; // Kernel node number of a CPU, -1 if it is not listed.
+    std::vector<int> cpus() const; // Every listed CPU, node by node.
+};
+
+// Parses a kernel CPU list such as "0-3,8,10-11" into CPU numbers.
+std::vector<int> parseCpuList(const std::string& list);
+
+#endif // NUMA_TOPOLOGY_HPP
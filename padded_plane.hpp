@@ -0,0 +1,195 @@
+#ifndef PADDED_PLANE_HPP
+#define PADDED_PLANE_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <Eigen/Dense> // Eigen maps over the plane interior.
+#include <vector> // Standard vector class for storage.
+#include <new> // Aligned operator new.
+#include <cstddef> // Size and pointer difference types.
+#include <algorithm> // Fill and copy helpers.
+#include "parallel_backend.hpp" // Zeroing large planes in parallel.
+
+// How the halo around a plane is filled.
+enum class BorderPolicy{
+    REPLICATE, // Repeat the outermost pixel: aaa|abc.
+    REFLECT,   // Mirror about the outermost pixel: cb|abc.
+    CONSTANT,  // Use a fixed value: kkk|abc.
+};
+
+// Allocator returning 64-byte (cache line) aligned storage.
+template<typename T>
+struct AlignedAllocator{
+    using value_type = T;
+    static constexpr std::size_t alignment = 64;
+
+    AlignedAllocator() = default;
+    template<typename U> AlignedAllocator(const AlignedAllocator<U>&){}
+
+    T* allocate(std::size_t n){ return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignment))); }
+    void deallocate(T* p, std::size_t){ ::operator delete(p, std::align_val_t(alignment)); }
+    // Default-initialises, so resize() leaves new pages untouched until they are first written.
+    template<typename U> void construct(U* p){ ::new(static_cast<void*>(p)) U; }
+
+    template<typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template<typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+// Column-major layout of a plane with a halo: every column starts on a 64-byte boundary
+// at row 0, and the halo cells around the image can be read without bounds checks.
+struct PaddedLayout{
+    int rows = 0; // Image height.
+    int cols = 0; // Image width.
+    int halo = 0; // Halo width on every side.
+    int lead = 0; // Elements between the start of a column and row 0.
+    int stride = 0; // Elements between consecutive columns.
+
+    // Lays out a plane of Scalar values.
+    template<typename Scalar>
+    static PaddedLayout make(int rows, int cols, int halo){
+        const int align = static_cast<int>(AlignedAllocator<Scalar>::alignment / sizeof(Scalar));
+        PaddedLayout layout;
+        layout.rows = rows;
+        layout.cols = cols;
+        layout.halo = halo;
+        layout.lead = (halo + align - 1) / align * align;
+        layout.stride = (layout.lead + rows + halo + align - 1) / align * align;
+        return layout;
+    }
+    std::size_t size() const { return static_cast<std::size_t>(stride) * (cols + 2 * halo); } // Elements in total.
+    std::size_t origin() const { return static_cast<std::size_t>(halo) * stride + lead; } // Offset of pixel (0, 0).
+};
+
+// Non-owning view of a padded plane. Pixel (i, j) is valid for i in [-halo, rows + halo)
+// and j in [-halo, cols + halo).
+template<typename Scalar>
+struct BasicPlaneView{
+    using Matrix = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>; // Plane type.
+
+    Scalar* origin = nullptr; // Pixel (0, 0).
+    int rows = 0; // Image height.
+    int cols = 0; // Image width.
+    int stride = 0; // Elements between consecutive columns.
+    int halo = 0; // Halo width on every side.
+
+    Scalar* col(int j) const { return origin + static_cast<std::ptrdiff_t>(j) * stride; } // Column j, indexed by row.
+    Scalar& operator()(int i, int j) const { return col(j)[i]; } // One pixel, halo included.
+
+    // The image without its halo, as an Eigen matrix.
+    Eigen::Map<Matrix, Eigen::Aligned64, Eigen::OuterStride<>> interior() const {
+        return Eigen::Map<Matrix, Eigen::Aligned64, Eigen::OuterStride<>>(origin, rows, cols, Eigen::OuterStride<>(stride));
+    }
+
+    // Maps an out-of-range index onto the image for the replicate and reflect policies.
+    static int border_index(int i, int n, BorderPolicy policy){
+        if(policy == BorderPolicy::REPLICATE){
+            return std::min(std::max(i, 0), n - 1);
+        }
+        if(n == 1){
+            return 0;
+        }
+        int period = 2 * n - 2;
+        int m = ((i % period) + period) % period;
+        return m < n ? m : period - m;
+    }
+
+    // Fills the halo from the image according to the policy. Clearing top or bottom keeps
+    // those halo rows as they are, e.g. when they hold the neighbouring rows of a strip.
+    void fillBorder(BorderPolicy policy, Scalar constant = Scalar(0), bool top = true, bool bottom = true) const {
+        if(halo == 0 || rows == 0 || cols == 0){
+            return;
+        }
+        // Top and bottom halo of the image columns
+        for(int j = 0; j < cols; ++j){
+            Scalar* column = col(j);
+            for(int i = -halo; i < 0 && top; ++i){
+                column[i] = policy == BorderPolicy::CONSTANT ? constant : column[border_index(i, rows, policy)];
+            }
+            for(int i = rows; i < rows + halo && bottom; ++i){
+                column[i] = policy == BorderPolicy::CONSTANT ? constant : column[border_index(i, rows, policy)];
+            }
+        }
+        // Left and right halo columns, corners included, copied from whole padded columns
+        for(int j = -halo; j < cols + halo; ++j){
+            if(j == 0){
+                j = cols - 1;
+                continue;
+            }
+            Scalar* column = col(j);
+            if(policy == BorderPolicy::CONSTANT){
+                std::fill(column - halo, column + rows + halo, constant);
+            } else {
+                const Scalar* source = col(border_index(j, cols, policy));
+                std::copy(source - halo, source + rows + halo, column - halo);
+            }
+        }
+    }
+};
+
+// BasicPaddedPlane owns a single padded, aligned plane.
+template<typename Scalar>
+class BasicPaddedPlane{
+public:
+    using Matrix = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>; // Plane type.
+    using View = BasicPlaneView<Scalar>; // View type.
+
+    // Constructors and destructors.
+    BasicPaddedPlane() = default; // Empty plane.
+    BasicPaddedPlane(int rows, int cols, int halo){ reshape(rows, cols, halo); } // Allocates a plane.
+
+    // Lays out the plane; returns true if the storage had to be reallocated.
+    bool reshape(int rows, int cols, int halo){
+        if(rows == layout.rows && cols == layout.cols && halo == layout.halo && !storage.empty()){
+            return false;
+        }
+        layout = PaddedLayout::make<Scalar>(rows, cols, halo);
+        bool grown = layout.size() > storage.capacity();
+        storage.clear();
+        storage.resize(layout.size());
+        zero();
+        return grown;
+    }
+
+    int rows() const { return layout.rows; } // Image height.
+    int cols() const { return layout.cols; } // Image width.
+    int halo() const { return layout.halo; } // Halo width.
+    std::size_t bytes() const { return storage.size() * sizeof(Scalar); } // Size of the storage.
+    std::size_t capacityBytes() const { return storage.capacity() * sizeof(Scalar); } // Storage allocated, more than bytes() after shrinking.
+
+    // View of the plane; the view stays valid until the next reshape.
+    View view(){
+        return View{storage.data() + layout.origin(), layout.rows, layout.cols, layout.stride, layout.halo};
+    }
+    // View of a const plane, which must only be read through.
+    View view() const { return const_cast<BasicPaddedPlane*>(this)->view(); }
+    // The image without its halo, as an Eigen matrix.
+    Eigen::Map<Matrix, Eigen::Aligned64, Eigen::OuterStride<>> interior(){ return view().interior(); }
+    Eigen::Map<const Matrix, Eigen::Aligned64, Eigen::OuterStride<>> interior() const {
+        return Eigen::Map<const Matrix, Eigen::Aligned64, Eigen::OuterStride<>>(storage.data() + layout.origin(), layout.rows, layout.cols,
+                                                                                 Eigen::OuterStride<>(layout.stride));
+    }
+
+private:
+    static constexpr std::size_t parallel_zero_bytes = std::size_t(1) << 20; // Planes from this size are zeroed in parallel.
+
+    PaddedLayout layout; // Shape and strides.
+    std::vector<Scalar, AlignedAllocator<Scalar>> storage; // Aligned storage, halo included.
+
+    // Zeroes the storage. The OS places a page on the NUMA node of the thread that first writes
+    // it, so large planes are zeroed in column bands by the threads of the pool that will process
+    // them: a node's pool keeps the plane on its node, the shared pool spreads it over all nodes.
+    void zero(){
+        Scalar* data = storage.data();
+        std::size_t column = static_cast<std::size_t>(layout.stride);
+        if(storage.size() * sizeof(Scalar) < parallel_zero_bytes || column == 0){
+            std::fill(storage.begin(), storage.end(), Scalar(0));
+            return;
+        }
+        parallel_for(0, static_cast<int>(storage.size() / column), [=](int col_begin, int col_end){
+            std::fill(data + col_begin * column, data + col_end * column, Scalar(0));
+        });
+    }
+};
+
+using PaddedPlane = BasicPaddedPlane<double>; // Double precision plane.
+
+#endif // PADDED_PLANE_HPP
@@ -0,0 +1,199 @@
+#include "parallel_backend.hpp"
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <iostream>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#if defined(EDGE_DETECTOR_USE_STD_EXECUTION)
+#include <execution>
+#include <iterator>
+#endif
+
+#if !defined(EDGE_DETECTOR_DEFAULT_BACKEND)
+#define EDGE_DETECTOR_DEFAULT_BACKEND POOL
+#endif
+
+namespace {
+// Backend from the environment, else the build default
+ParallelBackend initial_backend(){
+    ParallelBackend backend = ParallelBackend::EDGE_DETECTOR_DEFAULT_BACKEND;
+    if(const char* name = std::getenv("EDGE_DETECTOR_BACKEND")){
+        bool known = false;
+        for(ParallelBackend candidate : {ParallelBackend::POOL, ParallelBackend::OPENMP, ParallelBackend::STD_EXECUTION, ParallelBackend::SERIAL}){
+            if(std::strcmp(name, parallelBackendName(candidate)) == 0 && parallelBackendAvailable(candidate)){
+                backend = candidate;
+                known = true;
+            }
+        }
+        if(!known){
+            std::cerr << "Parallel backend " << name << " is not available, using " << parallelBackendName(backend) << std::endl;
+        }
+    }
+    return backend;
+}
+
+std::atomic<ParallelBackend>& current_backend(){
+    static std::atomic<ParallelBackend> backend{initial_backend()};
+    return backend;
+}
+
+#if defined(_OPENMP) || defined(EDGE_DETECTOR_USE_STD_EXECUTION)
+// Chunk size giving a few chunks per thread, unless the caller fixed one
+int pick_grain(int n_items, int grain, int n_threads){
+    return grain > 0 ? grain : std::max(1, n_items / (std::max(1, n_threads) * 4));
+}
+#endif
+
+#if defined(EDGE_DETECTOR_USE_STD_EXECUTION)
+// Parallel loops the calling thread is running a chunk of. A loop started from inside a chunk
+// runs on that thread: the execution policy has no notion of nesting, and a nested parallel
+// algorithm could otherwise run chunks of unrelated loops while this chunk's scratch is in use.
+thread_local int std_depth = 0;
+
+// Marks the calling thread as inside a chunk for the lifetime of the guard
+struct ChunkScope{
+    ChunkScope(){ ++std_depth; }
+    ~ChunkScope(){ --std_depth; }
+};
+
+// Random-access iterator over consecutive chunk numbers, so the parallel algorithm walks
+// a range of indices without an array of them
+class ChunkIterator{
+public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = int;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const int*;
+    using reference = int;
+
+    explicit ChunkIterator(int index = 0) : index(index){}
+
+    int operator*() const { return index; }
+    int operator[](difference_type k) const { return index + static_cast<int>(k); }
+    ChunkIterator& operator++(){ ++index; return *this; }
+    ChunkIterator& operator--(){ --index; return *this; }
+    ChunkIterator operator++(int){ return ChunkIterator(index++); }
+    ChunkIterator operator--(int){ return ChunkIterator(index--); }
+    ChunkIterator& operator+=(difference_type k){ index += static_cast<int>(k); return *this; }
+    ChunkIterator& operator-=(difference_type k){ index -= static_cast<int>(k); return *this; }
+    ChunkIterator operator+(difference_type k) const { return ChunkIterator(index + static_cast<int>(k)); }
+    ChunkIterator operator-(difference_type k) const { return ChunkIterator(index - static_cast<int>(k)); }
+    friend ChunkIterator operator+(difference_type k, const ChunkIterator& it){ return it + k; }
+    difference_type operator-(const ChunkIterator& other) const { return index - other.index; }
+    bool operator==(const ChunkIterator& other) const { return index == other.index; }
+    bool operator!=(const ChunkIterator& other) const { return index != other.index; }
+    bool operator<(const ChunkIterator& other) const { return index < other.index; }
+    bool operator>(const ChunkIterator& other) const { return index > other.index; }
+    bool operator<=(const ChunkIterator& other) const { return index <= other.index; }
+    bool operator>=(const ChunkIterator& other) const { return index >= other.index; }
+
+private:
+    int index; // Chunk number.
+};
+#endif
+}
+
+// Select the backend for later parallel_for calls
+bool setParallelBackend(ParallelBackend backend){
+    if(!parallelBackendAvailable(backend)){
+        std::cerr << "Parallel backend " << parallelBackendName(backend) << " was not compiled in" << std::endl;
+        return false;
+    }
+    current_backend().store(backend);
+    return true;
+}
+
+// The backend in use
+ParallelBackend parallelBackend(){
+    return current_backend().load();
+}
+
+// Only the pool and serial backends need nothing beyond the standard library
+bool parallelBackendAvailable(ParallelBackend backend){
+    switch(backend){
+        case ParallelBackend::OPENMP:
+#if defined(_OPENMP)
+            return true;
+#else
+            return false;
+#endif
+        case ParallelBackend::STD_EXECUTION:
+#if defined(EDGE_DETECTOR_USE_STD_EXECUTION)
+            return true;
+#else
+            return false;
+#endif
+        default:
+            return true;
+    }
+}
+
+// Name of a backend, as accepted by EDGE_DETECTOR_BACKEND
+const char* parallelBackendName(ParallelBackend backend){
+    switch(backend){
+        case ParallelBackend::POOL: return "pool";
+        case ParallelBackend::OPENMP: return "openmp";
+        case ParallelBackend::STD_EXECUTION: return "std";
+        case ParallelBackend::SERIAL: return "serial";
+    }
+    return "unknown";
+}
+
+// Dispatch a loop to the selected backend
+void parallel_for(int begin, int end, FunctionRef<void(int, int)> body, int grain){
+    if(end <= begin){
+        return;
+    }
+    switch(parallelBackend()){
+        case ParallelBackend::POOL:
+            // A loop started by a pool task, e.g. on a NUMA node's pool, stays on that pool
+            ThreadPool::current().parallelFor(begin, end, body, grain);
+            return;
+        case ParallelBackend::OPENMP:
+#if defined(_OPENMP)
+        {
+            // Loops nested inside a parallel region run on the thread that reached them
+            if(omp_in_parallel()){
+                body(begin, end);
+                return;
+            }
+            int chunk = pick_grain(end - begin, grain, omp_get_max_threads());
+            int n_chunks = (end - begin + chunk - 1) / chunk;
+            #pragma omp parallel for schedule(dynamic)
+            for(int c = 0; c < n_chunks; ++c){
+                body(begin + c * chunk, std::min(end, begin + (c + 1) * chunk));
+            }
+            return;
+        }
+#endif
+        case ParallelBackend::STD_EXECUTION:
+#if defined(EDGE_DETECTOR_USE_STD_EXECUTION)
+        {
+            // Loops nested inside a chunk run on the thread that reached them, as with OpenMP
+            if(std_depth > 0){
+                body(begin, end);
+                return;
+            }
+            // par rather than par_unseq: loop bodies may lock a mutex to merge band results
+            int chunk = pick_grain(end - begin, grain, static_cast<int>(std::thread::hardware_concurrency()));
+            int n_chunks = (end - begin + chunk - 1) / chunk;
+            std::for_each(std::execution::par, ChunkIterator(0), ChunkIterator(n_chunks), [&](int c){
+                ChunkScope scope;
+                body(begin + c * chunk, std::min(end, begin + (c + 1) * chunk));
+            });
+            return;
+        }
+#endif
+        case ParallelBackend::SERIAL:
+            body(begin, end);
+            return;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef PARALLEL_BACKEND_HPP
+#define PARALLEL_BACKEND_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include "function_ref.hpp" // Loop bodies, referenced without allocating.
+
+// Implementations that parallel_for can run a loop on. Every detector pass splits its work into
+// independent row or column bands, so all backends produce identical results.
+//
+// Build flags: OPENMP is compiled in when building with -fopenmp, and STD_EXECUTION when
+// EDGE_DETECTOR_USE_STD_EXECUTION is defined (libstdc++ then needs -ltbb). The backend used
+// at startup is EDGE_DETECTOR_DEFAULT_BACKEND (POOL unless defined, e.g. -DEDGE_DETECTOR_DEFAULT_BACKEND=SERIAL),
+// overridden by the EDGE_DETECTOR_BACKEND environment variable (pool, openmp, std or serial)
+// and at run time by setParallelBackend.
+enum class ParallelBackend{
+    POOL,          // Built-in work-stealing ThreadPool.
+    OPENMP,        // OpenMP worksharing on the host application's OpenMP threads.
+    STD_EXECUTION, // C++17 parallel algorithms (std::for_each with std::execution::par).
+    SERIAL,        // The calling thread only; no threads are started.
+};
+
+bool setParallelBackend(ParallelBackend backend); // Selects the backend; false if it was not compiled in.
+ParallelBackend parallelBackend(); // The backend parallel_for currently uses.
+bool parallelBackendAvailable(ParallelBackend backend); // True if the backend was compiled in.
+const char* parallelBackendName(ParallelBackend backend); // Short name, as accepted by EDGE_DETECTOR_BACKEND.
+
+// Runs body(chunk_begin, chunk_end) over [begin, end) on the selected backend. Chunks have at
+// most grain items (0 picks a grain from the number of threads); the call returns when every
+// chunk is done.
+void parallel_for(int begin, int end, FunctionRef<void(int, int)> body, int grain = 0);
+
+#endif // PARALLEL_BACKEND_HPP
@@ -0,0 +1,191 @@
+#include "pixel_convert.hpp"
+
+#include <cstring>
+#include <cstddef>
+
+#if defined(__SSSE3__) || defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+// Widen and convert elements [k, n) of a column one at a time
+template<typename Scalar>
+void unpack_tail(const unsigned char* const* bytes, int channels, int k, int n, Scalar* const* out, Scalar* gray){
+    for(; k < n; ++k){
+        for(int c = 0; c < channels; ++c){
+            out[c][k] = static_cast<Scalar>(bytes[c][k]);
+        }
+        if(gray){
+            gray[k] = channels >= 3 ? luma(out[0][k], out[1][k], out[2][k]) : out[0][k];
+        }
+    }
+}
+}
+
+// De-interleave a row: 16 pixels per step with byte shuffles, the remainder one pixel at a time
+void deinterleaveRow(const unsigned char* pixels, int count, int channels, unsigned char* const* channel_rows){
+    if(channels == 1){
+        std::memcpy(channel_rows[0], pixels, count);
+        return;
+    }
+    int j = 0;
+#if defined(__SSSE3__)
+    if(channels == 3){
+        // Channel c of pixel p is byte 3p + c of the 48 loaded bytes; each output gathers from all three
+        // registers, and lanes set to -128 are zeroed so the three parts can be or'ed together
+        const __m128i r0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i r1 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, 2, 5, 8, 11, 14, -128, -128, -128, -128, -128);
+        const __m128i r2 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 1, 4, 7, 10, 13);
+        const __m128i g0 = _mm_setr_epi8(1, 4, 7, 10, 13, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i g1 = _mm_setr_epi8(-128, -128, -128, -128, -128, 0, 3, 6, 9, 12, 15, -128, -128, -128, -128, -128);
+        const __m128i g2 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 2, 5, 8, 11, 14);
+        const __m128i b0 = _mm_setr_epi8(2, 5, 8, 11, 14, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128);
+        const __m128i b1 = _mm_setr_epi8(-128, -128, -128, -128, -128, 1, 4, 7, 10, 13, -128, -128, -128, -128, -128, -128);
+        const __m128i b2 = _mm_setr_epi8(-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 0, 3, 6, 9, 12, 15);
+        for(; j + 16 <= count; j += 16){
+            const unsigned char* p = pixels + 3 * j;
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+            __m128i red = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, r0), _mm_shuffle_epi8(b, r1)), _mm_shuffle_epi8(c, r2));
+            __m128i green = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, g0), _mm_shuffle_epi8(b, g1)), _mm_shuffle_epi8(c, g2));
+            __m128i blue = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, b0), _mm_shuffle_epi8(b, b1)), _mm_shuffle_epi8(c, b2));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(channel_rows[0] + j), red);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(channel_rows[1] + j), green);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(channel_rows[2] + j), blue);
+        }
+    } else if(channels == 4){
+        // Group each register's bytes by channel, then transpose the 4x4 grid of 32-bit groups
+        const __m128i group = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+        for(; j + 16 <= count; j += 16){
+            const unsigned char* p = pixels + 4 * j;
+            __m128i x0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), group);
+            __m128i x1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), group);
+            __m128i x2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)), group);
+            __m128i x3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)), group);
+            __m128i t0 = _mm_unpacklo_epi32(x0, x1);
+            __m128i t1 = _mm_unpacklo_epi32(x2, x3);
+            __m128i t2 = _mm_unpackhi_epi32(x0, x1);
+            __m128i t3 = _mm_unpackhi_epi32(x2, x3);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(channel_rows[0] + j), _mm_unpacklo_epi64(t0, t1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(channel_rows[1] + j), _mm_unpackhi_epi64(t0, t1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(channel_rows[2] + j), _mm_unpacklo_epi64(t2, t3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(channel_rows[3] + j), _mm_unpackhi_epi64(t2, t3));
+        }
+    } else if(channels == 2){
+        // Even bytes to the low half, odd bytes to the high half
+        const __m128i split = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+        for(; j + 16 <= count; j += 16){
+            const unsigned char* p = pixels + 2 * j;
+            __m128i x0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), split);
+            __m128i x1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), split);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(channel_rows[0] + j), _mm_unpacklo_epi64(x0, x1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(channel_rows[1] + j), _mm_unpackhi_epi64(x0, x1));
+        }
+    }
+#endif
+    for(; j < count; ++j){
+        for(int c = 0; c < channels; ++c){
+            channel_rows[c][j] = pixels[j * channels + c];
+        }
+    }
+}
+
+// Transpose bytes: 8 rows x 16 columns per step in three rounds of unpacks, the edges one byte at a time
+void transposeBytes(const unsigned char* rows, int row_stride, int n_rows, int n_cols, unsigned char* columns, int column_stride){
+    int i0 = 0;
+#if defined(__SSE2__)
+    for(; i0 + 8 <= n_rows; i0 += 8){
+        int j0 = 0;
+        for(; j0 + 16 <= n_cols; j0 += 16){
+            __m128i r[8];
+            for(int k = 0; k < 8; ++k){
+                r[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows + static_cast<std::size_t>(i0 + k) * row_stride + j0));
+            }
+            // Pairs of rows, then quads, then all eight rows of a column end up next to each other
+            __m128i a[8], b[8];
+            for(int k = 0; k < 4; ++k){
+                a[2 * k] = _mm_unpacklo_epi8(r[2 * k], r[2 * k + 1]);
+                a[2 * k + 1] = _mm_unpackhi_epi8(r[2 * k], r[2 * k + 1]);
+            }
+            for(int k = 0; k < 2; ++k){
+                b[4 * k] = _mm_unpacklo_epi16(a[4 * k], a[4 * k + 2]);
+                b[4 * k + 1] = _mm_unpackhi_epi16(a[4 * k], a[4 * k + 2]);
+                b[4 * k + 2] = _mm_unpacklo_epi16(a[4 * k + 1], a[4 * k + 3]);
+                b[4 * k + 3] = _mm_unpackhi_epi16(a[4 * k + 1], a[4 * k + 3]);
+            }
+            for(int k = 0; k < 4; ++k){
+                // Columns 4k .. 4k + 3, eight bytes each
+                __m128i low = _mm_unpacklo_epi32(b[k], b[k + 4]);
+                __m128i high = _mm_unpackhi_epi32(b[k], b[k + 4]);
+                unsigned char* column = columns + static_cast<std::size_t>(j0 + 4 * k) * column_stride + i0;
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(column), low);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(column + column_stride), _mm_unpackhi_epi64(low, low));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(column + 2 * column_stride), high);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(column + 3 * column_stride), _mm_unpackhi_epi64(high, high));
+            }
+        }
+        for(; j0 < n_cols; ++j0){
+            for(int k = 0; k < 8; ++k){
+                columns[static_cast<std::size_t>(j0) * column_stride + i0 + k] = rows[static_cast<std::size_t>(i0 + k) * row_stride + j0];
+            }
+        }
+    }
+#endif
+    for(int i = i0; i < n_rows; ++i){
+        for(int j = 0; j < n_cols; ++j){
+            columns[static_cast<std::size_t>(j) * column_stride + i] = rows[static_cast<std::size_t>(i) * row_stride + j];
+        }
+    }
+}
+
+// Four doubles per step: zero-extend bytes to 32 bits, convert, and apply the luma weights with the
+// same multiply and fused multiply-adds as luma()
+void unpackColumn(const unsigned char* const* bytes, int channels, int n, double* const* out, double* gray){
+    int k = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+    const __m256d red = _mm256_set1_pd(0.2989), green = _mm256_set1_pd(0.5870), blue = _mm256_set1_pd(0.1140);
+    for(; k + 4 <= n; k += 4){
+        __m256d values[4];
+        for(int c = 0; c < channels; ++c){
+            int packed;
+            std::memcpy(&packed, bytes[c] + k, 4);
+            values[c] = _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+            _mm256_stream_pd(out[c] + k, values[c]);
+        }
+        if(gray){
+            __m256d value = channels >= 3 ? _mm256_fmadd_pd(values[2], blue, _mm256_fmadd_pd(values[1], green, _mm256_mul_pd(values[0], red))) : values[0];
+            _mm256_stream_pd(gray + k, value);
+        }
+    }
+#endif
+    unpack_tail(bytes, channels, k, n, out, gray);
+}
+
+// Eight floats per step
+void unpackColumn(const unsigned char* const* bytes, int channels, int n, float* const* out, float* gray){
+    int k = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+    const __m256 red = _mm256_set1_ps(0.2989f), green = _mm256_set1_ps(0.5870f), blue = _mm256_set1_ps(0.1140f);
+    for(; k + 8 <= n; k += 8){
+        __m256 values[4];
+        for(int c = 0; c < channels; ++c){
+            __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(bytes[c] + k));
+            values[c] = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(packed));
+            _mm256_stream_ps(out[c] + k, values[c]);
+        }
+        if(gray){
+            __m256 value = channels >= 3 ? _mm256_fmadd_ps(values[2], blue, _mm256_fmadd_ps(values[1], green, _mm256_mul_ps(values[0], red))) : values[0];
+            _mm256_stream_ps(gray + k, value);
+        }
+    }
+#endif
+    unpack_tail(bytes, channels, k, n, out, gray);
+}
+
+// Streaming stores are weakly ordered; the fence makes them visible before the band is reported done
+void streamFence(){
+#if defined(__AVX2__) && defined(__FMA__)
+    _mm_sfence();
+#endif
+}
@@ -0,0 +1,38 @@
+#ifndef PIXEL_CONVERT_HPP
+#define PIXEL_CONVERT_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <cmath> // Fused multiply-add.
+
+// Splits count interleaved 8-bit pixels with 1 to 4 channels into one byte row per channel,
+// with SSSE3 byte shuffles when available.
+void deinterleaveRow(const unsigned char* pixels, int count, int channels, unsigned char* const* channel_rows);
+
+// Transposes an n_rows x n_cols block of bytes, rows row_stride apart, into columns column_stride
+// apart, with SSE2 unpacks on 8 x 16 tiles when available. Used to turn de-interleaved rows into
+// the column-major layout of the planes.
+void transposeBytes(const unsigned char* rows, int row_stride, int n_rows, int n_cols, unsigned char* columns, int column_stride);
+
+// Widens one column of n de-interleaved bytes per channel into the plane columns out[c] and, if gray
+// is not null, writes the grayscale column: luma of the first three channels, or a copy of the first
+// channel for grey with or without alpha. With AVX2 and FMA, groups of a full vector use streaming
+// stores, which write whole cache lines without reading them first since the planes are much larger
+// than the cache; destinations must then be 32-byte aligned, and streamFence() must run before other
+// threads read the planes.
+void unpackColumn(const unsigned char* const* bytes, int channels, int n, double* const* out, double* gray);
+void unpackColumn(const unsigned char* const* bytes, int channels, int n, float* const* out, float* gray);
+void streamFence(); // Orders earlier streaming stores before later stores, e.g. the end of a parallel band.
+
+// Grayscale value of one pixel. Every conversion in the library goes through this function,
+// so the plane converted at load and rows converted later for strips are bit-identical. With
+// FMA hardware (-mfma) the weighted sum uses fused multiply-adds, which the compiler vectorizes.
+template<typename Scalar>
+inline Scalar luma(Scalar r, Scalar g, Scalar b){
+#if defined(__FMA__)
+    return std::fma(b, Scalar(0.1140), std::fma(g, Scalar(0.5870), r * Scalar(0.2989)));
+#else
+    return r * Scalar(0.2989) + g * Scalar(0.5870) + b * Scalar(0.1140);
+#endif
+}
+
+#endif // PIXEL_CONVERT_HPP
@@ -0,0 +1,75 @@
+#ifndef PLANE_STACK_HPP
+#define PLANE_STACK_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <Eigen/Dense> // Eigen maps over the shared storage.
+#include <vector> // Standard vector class for storage and plane shapes.
+#include <utility> // Pair for plane shapes.
+#include <cstddef> // Size type for offsets.
+#include "padded_plane.hpp" // Aligned, padded plane layout.
+
+// BasicPlaneStack stores several 2D planes, possibly of different sizes, back to back in one
+// contiguous allocation. Each plane is exposed as an Eigen map over its part of the storage.
+// Planes use the PaddedLayout of padded_plane.hpp: 64-byte aligned columns and an optional halo.
+template<typename Scalar>
+class BasicPlaneStack{
+public:
+    using Matrix = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>; // Plane type.
+    using Map = Eigen::Map<Matrix, Eigen::Aligned64, Eigen::OuterStride<>>; // Mutable plane.
+    using ConstMap = Eigen::Map<const Matrix, Eigen::Aligned64, Eigen::OuterStride<>>; // Read-only plane.
+    using View = BasicPlaneView<Scalar>; // Plane including its halo.
+
+    // Constructors and destructors.
+    BasicPlaneStack() = default; // Empty stack.
+    explicit BasicPlaneStack(const std::vector<std::pair<int, int>>& shapes, int halo = 0){ reshape(shapes, halo); } // Allocates planes of the given (rows, cols).
+
+    // Lays out planes of the given (rows, cols) with a halo of the given width around each;
+    // the storage is zero-filled and only reallocated when it has to grow.
+    void reshape(const std::vector<std::pair<int, int>>& shapes, int halo = 0){
+        layouts.clear();
+        offsets.clear();
+        std::size_t total = 0;
+        for(const auto& shape : shapes){
+            layouts.push_back(PaddedLayout::make<Scalar>(shape.first, shape.second, halo));
+            offsets.push_back(total + layouts.back().origin());
+            total += layouts.back().size();
+        }
+        storage.assign(total, Scalar(0));
+    }
+
+    int size() const { return static_cast<int>(offsets.size()); } // Number of planes.
+    bool empty() const { return offsets.empty(); } // True when no planes are stored.
+    int rows(int plane) const { return layouts[plane].rows; } // Height of a plane.
+    int cols(int plane) const { return layouts[plane].cols; } // Width of a plane.
+
+    // Access to a plane, without its halo, as an Eigen matrix.
+    Map operator[](int plane){
+        return Map(storage.data() + offsets[plane], rows(plane), cols(plane), Eigen::OuterStride<>(layouts[plane].stride));
+    }
+    ConstMap operator[](int plane) const {
+        return ConstMap(storage.data() + offsets[plane], rows(plane), cols(plane), Eigen::OuterStride<>(layouts[plane].stride));
+    }
+
+    // Access to a plane including its halo.
+    View view(int plane){
+        return View{storage.data() + offsets[plane], rows(plane), cols(plane), layouts[plane].stride, layouts[plane].halo};
+    }
+
+    // Maps of every plane, e.g. for range-based loops.
+    std::vector<Map> planes(){
+        std::vector<Map> maps;
+        for(int plane = 0; plane < size(); ++plane){
+            maps.push_back((*this)[plane]);
+        }
+        return maps;
+    }
+
+private:
+    std::vector<Scalar, AlignedAllocator<Scalar>> storage; // Single allocation holding every plane.
+    std::vector<PaddedLayout> layouts; // Shape and strides of each plane.
+    std::vector<std::size_t> offsets; // Pixel (0, 0) of each plane within storage.
+};
+
+using PlaneStack = BasicPlaneStack<double>; // Double precision planes.
+
+#endif // PLANE_STACK_HPP
@@ -0,0 +1,55 @@
+#include "edge_detector.hpp"
+
+// Compares the float detector against the double detector on every detector and direction.
+// Usage: precision_report [image ...]; defaults to the reference images in Images/.
+int main(int argc, char** argv){
+
+    std::vector<std::string> image_paths(argv + 1, argv + argc);
+    if(image_paths.empty()){
+        image_paths = {"Images/000000_10_sobel.png", "Images/000000_10_prewitt.png", "Images/000000_10_robertscross.png"};
+    }
+
+    const std::vector<std::pair<EdgeDetector::DetectorType, std::string>> detectors = {
+        {EdgeDetector::DetectorType::SOBEL, "SOBEL"},
+        {EdgeDetector::DetectorType::PREWITT, "PREWITT"},
+        {EdgeDetector::DetectorType::ROBERTSCROSS, "ROBERTSCROSS"},
+        {EdgeDetector::DetectorType::LOG, "LOG"},
+        {EdgeDetector::DetectorType::DOG, "DOG"},
+    };
+    const std::vector<std::pair<EdgeDetector::GradientType, std::string>> directions = {
+        {EdgeDetector::GradientType::X, "X"},
+        {EdgeDetector::GradientType::Y, "Y"},
+        {EdgeDetector::GradientType::MAG, "MAG"},
+    };
+
+    std::cout << "image,detector,direction,max_abs_error,mean_abs_error,max_rel_error,quantized_mismatch" << std::endl;
+    for(const auto& path : image_paths){
+        EdgeDetector detector;
+        EdgeDetectorF detector_f;
+        if(!detector.loadImage(path) || !detector_f.loadImage(path)){
+            return 1;
+        }
+
+        for(const auto& [detector_type, detector_name] : detectors){
+            for(const auto& [direction, direction_name] : directions){
+                Eigen::MatrixXd reference = detector.applyDetector(detector_type, direction);
+                Eigen::MatrixXd single = detector_f.applyDetector(detector_type, direction).cast<double>();
+
+                // Every pixel, border included, is defined by the detectors
+                auto ref = reference.array();
+                auto sgl = single.array();
+                Eigen::ArrayXXd error = (ref - sgl).abs();
+                double scale = std::max(ref.abs().maxCoeff(), 1e-12);
+
+                // Pixels whose saved 8-bit value would differ
+                Eigen::Index mismatch = (ref.cast<int>() != sgl.cast<int>()).count();
+
+                std::cout << path << "," << detector_name << "," << direction_name << ","
+                          << error.maxCoeff() << "," << error.mean() << "," << error.maxCoeff() / scale << ","
+                          << static_cast<double>(mismatch) / error.size() << std::endl;
+            }
+        }
+    }
+
+    return 0;
+}
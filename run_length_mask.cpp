@@ -0,0 +1,239 @@
+#include "run_length_mask.hpp"
+#include "parallel_backend.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+// Identifies files written by RunLengthMask::save
+static const char rle_magic[4] = {'R', 'L', 'E', '1'};
+
+// Concatenate per-row runs; the offset index is the prefix sum of the row sizes
+RunLengthMask::RunLengthMask(int rows, int cols, const std::vector<std::vector<Run>>& row_runs) : n_rows(rows), n_cols(cols){
+    row_offsets.assign(rows + 1, 0);
+    for(int r = 0; r < rows; ++r){
+        row_offsets[r + 1] = row_offsets[r] + row_runs[r].size();
+    }
+    runs.resize(row_offsets[rows]);
+    parallel_for(0, rows, [&](int row_begin, int row_end){
+        for(int r = row_begin; r < row_end; ++r){
+            std::copy(row_runs[r].begin(), row_runs[r].end(), runs.begin() + row_offsets[r]);
+        }
+    });
+}
+
+// Encode a bit-packed mask, scanning the words of each row for transitions
+RunLengthMask RunLengthMask::fromBitMask(const BitMask& mask){
+    std::vector<std::vector<Run>> row_runs(mask.rows());
+    parallel_for(0, mask.rows(), [&](int row_begin, int row_end){
+        for(int r = row_begin; r < row_end; ++r){
+            const std::uint64_t* words = mask.row(r);
+            int c = 0;
+            while(c < mask.cols()){
+                // Skip clear pixels a word at a time
+                std::uint64_t word = words[c >> 6] >> (c & 63);
+                if(!word){
+                    c = ((c >> 6) + 1) << 6;
+                    continue;
+                }
+                c += __builtin_ctzll(word);
+                int start = c;
+                // Extend the run to the next clear pixel, possibly across words
+                while(c < mask.cols()){
+                    std::uint64_t clear = ~words[c >> 6] >> (c & 63);
+                    if(!clear){
+                        c = ((c >> 6) + 1) << 6;
+                        continue;
+                    }
+                    c += __builtin_ctzll(clear);
+                    break;
+                }
+                c = std::min(c, mask.cols());
+                row_runs[r].push_back({static_cast<std::uint32_t>(start), static_cast<std::uint32_t>(c - start)});
+            }
+        }
+    });
+    return RunLengthMask(mask.rows(), mask.cols(), row_runs);
+}
+
+// Expand every row into a bit-packed mask
+BitMask RunLengthMask::toBitMask() const{
+    BitMask mask(n_rows, n_cols);
+    parallel_for(0, n_rows, [&](int row_begin, int row_end){
+        for(int r = row_begin; r < row_end; ++r){
+            decodeRow(r, mask.row(r));
+        }
+    });
+    return mask;
+}
+
+// Find the last run starting at or before c and check whether it covers c
+bool RunLengthMask::get(int r, int c) const{
+    const Run* begin = rowBegin(r);
+    const Run* end = rowEnd(r);
+    const Run* after = std::upper_bound(begin, end, static_cast<std::uint32_t>(c),
+                                        [](std::uint32_t column, const Run& run){ return column < run.start; });
+    if(after == begin){
+        return false;
+    }
+    const Run& run = *(after - 1);
+    return static_cast<std::uint32_t>(c) < run.start + run.length;
+}
+
+// Set the bits of each run, whole words at a time in the middle of long runs
+void RunLengthMask::decodeRow(int r, std::uint64_t* words) const{
+    std::fill(words, words + (n_cols + 63) / 64, 0);
+    for(const Run* run = rowBegin(r); run != rowEnd(r); ++run){
+        std::uint32_t c = run->start;
+        std::uint32_t end = run->start + run->length;
+        while(c < end){
+            std::uint32_t bit = c & 63;
+            std::uint32_t span = std::min<std::uint32_t>(64 - bit, end - c);
+            std::uint64_t bits = span == 64 ? ~std::uint64_t(0) : ((std::uint64_t(1) << span) - 1);
+            words[c >> 6] |= bits << bit;
+            c += span;
+        }
+    }
+}
+
+// Sum of the run lengths
+std::size_t RunLengthMask::count() const{
+    std::size_t total = 0;
+    for(const Run& run : runs){
+        total += run.length;
+    }
+    return total;
+}
+
+// Merge two masks of the same size row by row
+template<typename Merge>
+RunLengthMask RunLengthMask::combine(const RunLengthMask& other, Merge merge) const{
+    if(n_rows != other.n_rows || n_cols != other.n_cols){
+        std::cerr << "Mask sizes do not match" << std::endl;
+        return RunLengthMask();
+    }
+    std::vector<std::vector<Run>> row_runs(n_rows);
+    parallel_for(0, n_rows, [&](int row_begin, int row_end){
+        for(int r = row_begin; r < row_end; ++r){
+            merge(rowBegin(r), rowEnd(r), other.rowBegin(r), other.rowEnd(r), row_runs[r]);
+        }
+    });
+    return RunLengthMask(n_rows, n_cols, row_runs);
+}
+
+// Intersection: walk both sorted run lists and keep the overlaps
+RunLengthMask RunLengthMask::operator&(const RunLengthMask& other) const{
+    return combine(other, [](const Run* a, const Run* a_end, const Run* b, const Run* b_end, std::vector<Run>& out){
+        while(a != a_end && b != b_end){
+            std::uint32_t start = std::max(a->start, b->start);
+            std::uint32_t end = std::min(a->start + a->length, b->start + b->length);
+            if(start < end){
+                out.push_back({start, end - start});
+            }
+            // Advance whichever run ends first
+            if(a->start + a->length < b->start + b->length){
+                ++a;
+            } else {
+                ++b;
+            }
+        }
+    });
+}
+
+// Union: take runs in order of their start and fuse the ones that touch or overlap
+RunLengthMask RunLengthMask::operator|(const RunLengthMask& other) const{
+    return combine(other, [](const Run* a, const Run* a_end, const Run* b, const Run* b_end, std::vector<Run>& out){
+        while(a != a_end || b != b_end){
+            const Run* next;
+            if(b == b_end || (a != a_end && a->start <= b->start)){
+                next = a++;
+            } else {
+                next = b++;
+            }
+            if(!out.empty() && next->start <= out.back().start + out.back().length){
+                std::uint32_t end = std::max(out.back().start + out.back().length, next->start + next->length);
+                out.back().length = end - out.back().start;
+            } else {
+                out.push_back(*next);
+            }
+        }
+    });
+}
+
+// File layout (native byte order): magic, rows, cols, run count, row offsets, runs
+bool RunLengthMask::save(const std::string& filename) const{
+    std::ofstream file(filename, std::ios::binary);
+    if(!file){
+        std::cerr << "Failed to save image" << std::endl;
+        return false;
+    }
+    std::int32_t shape[2] = {n_rows, n_cols};
+    std::uint64_t n_runs = runs.size();
+    file.write(rle_magic, sizeof(rle_magic));
+    file.write(reinterpret_cast<const char*>(shape), sizeof(shape));
+    file.write(reinterpret_cast<const char*>(&n_runs), sizeof(n_runs));
+    file.write(reinterpret_cast<const char*>(row_offsets.data()), row_offsets.size() * sizeof(std::uint64_t));
+    file.write(reinterpret_cast<const char*>(runs.data()), runs.size() * sizeof(Run));
+    if(!file){
+        std::cerr << "Failed to save image" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Read a file written by save. The header is checked against the file size before anything is
+// allocated, and the index and runs before they replace the mask, so a damaged or crafted file
+// is rejected instead of making decodeRow write past a row
+bool RunLengthMask::load(const std::string& filename){
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    std::streamoff file_size = file ? static_cast<std::streamoff>(file.tellg()) : 0;
+    file.seekg(0);
+    char magic[4];
+    std::int32_t shape[2];
+    std::uint64_t n_runs;
+    // Rows up to the largest int, columns short of it by a word so that (cols + 63) / 64 cannot overflow
+    if(!file.read(magic, sizeof(magic)) || std::memcmp(magic, rle_magic, sizeof(magic)) != 0 ||
+       !file.read(reinterpret_cast<char*>(shape), sizeof(shape)) || shape[0] < 0 || shape[1] < 0 || shape[1] > INT32_MAX - 63 ||
+       !file.read(reinterpret_cast<char*>(&n_runs), sizeof(n_runs))){
+        std::cerr << "Error loading image" << std::endl;
+        return false;
+    }
+    // The index and the runs must fill the rest of the file exactly
+    std::uint64_t remaining = static_cast<std::uint64_t>(file_size) - (sizeof(magic) + sizeof(shape) + sizeof(n_runs));
+    std::uint64_t index_bytes = (static_cast<std::uint64_t>(shape[0]) + 1) * sizeof(std::uint64_t);
+    if(static_cast<std::uint64_t>(file_size) < sizeof(magic) + sizeof(shape) + sizeof(n_runs) || index_bytes > remaining ||
+       n_runs != (remaining - index_bytes) / sizeof(Run) || (remaining - index_bytes) % sizeof(Run) != 0){
+        std::cerr << "Error loading image: size does not match the header" << std::endl;
+        return false;
+    }
+    std::vector<std::uint64_t> offsets(shape[0] + 1);
+    std::vector<Run> data(n_runs);
+    if(!file.read(reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(std::uint64_t)) ||
+       !file.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(Run)) ||
+       offsets.front() != 0 || offsets.back() != n_runs){
+        std::cerr << "Error loading image" << std::endl;
+        return false;
+    }
+    // Offsets never decrease, and every row's runs are sorted, disjoint and inside the row
+    for(int r = 0; r < shape[0]; ++r){
+        if(offsets[r] > offsets[r + 1] || offsets[r + 1] > n_runs){
+            std::cerr << "Error loading image: bad row index" << std::endl;
+            return false;
+        }
+        std::uint64_t previous_end = 0;
+        for(std::uint64_t k = offsets[r]; k < offsets[r + 1]; ++k){
+            std::uint64_t end = static_cast<std::uint64_t>(data[k].start) + data[k].length;
+            if(data[k].start < previous_end || end > static_cast<std::uint64_t>(shape[1])){
+                std::cerr << "Error loading image: bad run in row " << r << std::endl;
+                return false;
+            }
+            previous_end = end;
+        }
+    }
+    n_rows = shape[0];
+    n_cols = shape[1];
+    row_offsets = std::move(offsets);
+    runs = std::move(data);
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef RUN_LENGTH_MASK_HPP
+#define RUN_LENGTH_MASK_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <vector> // Storage for runs and the row index.
+#include <string> // Filenames for saving and loading.
+#include <cstdint> // Fixed-width run and offset types.
+#include <cstddef> // Size type for counts.
+#include <cmath> // Absolute values when encoding.
+#include "bit_mask.hpp" // Conversion to and from bit-packed masks.
+
+// RunLengthMask stores a binary mask as runs of set pixels. The runs of all rows are kept in
+// one array, and a per-row offset index lets any row be read or decoded on its own.
+// AND and OR work directly on the runs without expanding the mask.
+class RunLengthMask{
+public:
+    // A run of set pixels [start, start + length) within one row.
+    struct Run{
+        std::uint32_t start; // First column of the run.
+        std::uint32_t length; // Number of pixels in the run.
+    };
+
+    // Constructors and destructors.
+    RunLengthMask() = default; // Empty mask.
+    RunLengthMask(int rows, int cols, const std::vector<std::vector<Run>>& row_runs); // Builds the index from per-row runs.
+
+    static RunLengthMask fromBitMask(const BitMask& mask); // Encodes a bit-packed mask, rows in parallel.
+    BitMask toBitMask() const; // Decodes the whole mask.
+
+    // Appends the runs of |values[j]| > threshold over one row of values.
+    template<typename Scalar>
+    static void encodeRow(const Scalar* values, int cols, Scalar threshold, std::vector<Run>& runs){
+        int j = 0;
+        while(j < cols){
+            while(j < cols && !(std::abs(values[j]) > threshold)){
+                ++j;
+            }
+            int start = j;
+            while(j < cols && std::abs(values[j]) > threshold){
+                ++j;
+            }
+            if(j > start){
+                runs.push_back({static_cast<std::uint32_t>(start), static_cast<std::uint32_t>(j - start)});
+            }
+        }
+    }
+
+    int rows() const { return n_rows; } // Mask height.
+    int cols() const { return n_cols; } // Mask width.
+    std::size_t runCount() const { return runs.size(); } // Total number of runs.
+    const Run* rowBegin(int r) const { return runs.data() + row_offsets[r]; } // First run of a row.
+    const Run* rowEnd(int r) const { return runs.data() + row_offsets[r + 1]; } // One past the last run of a row.
+
+    bool get(int r, int c) const; // Reads one pixel by binary search in its row.
+    void decodeRow(int r, std::uint64_t* words) const; // Writes one row in BitMask layout ((cols + 63) / 64 words).
+    std::size_t count() const; // Number of set pixels.
+
+    RunLengthMask operator&(const RunLengthMask& other) const; // Pixels set in both masks.
+    RunLengthMask operator|(const RunLengthMask& other) const; // Pixels set in either mask.
+
+    bool save(const std::string& filename) const; // Writes the runs and row index to a binary file.
+    bool load(const std::string& filename); // Reads a file written by save; false, leaving the mask as it was, if the file is damaged.
+
+private:
+    int n_rows = 0; // Mask height.
+    int n_cols = 0; // Mask width.
+    std::vector<std::uint64_t> row_offsets{0}; // Index of the first run of each row, plus the total.
+    std::vector<Run> runs; // Runs of all rows, row after row.
+
+    // Applies a run-merging function to every row pair, rows in parallel.
+    template<typename Merge>
+    RunLengthMask combine(const RunLengthMask& other, Merge merge) const;
+};
+
+#endif // RUN_LENGTH_MASK_HPP
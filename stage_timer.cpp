@@ -0,0 +1,188 @@
+#include "stage_timer.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <thread>
+
+namespace {
+// Cumulative counters behind the histograms
+struct HistogramCounters{
+    std::array<std::atomic<std::uint64_t>, StageHistogram::bucket_count> counts{}; // Calls per bucket.
+    std::atomic<std::uint64_t> calls{0}; // Calls that ran the stage.
+    std::atomic<std::uint64_t> total_ns{0}; // Time in the stage in nanoseconds.
+};
+
+std::array<HistogramCounters, stage_count>& histograms(){
+    static std::array<HistogramCounters, stage_count> counters;
+    return counters;
+}
+
+// Timer and clock readings taken at startup, the reference for the calibration
+struct CalibrationStart{
+    std::uint64_t ticks = readTicks(); // Timer at startup.
+    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now(); // Clock at startup.
+};
+const CalibrationStart calibration_start;
+
+constexpr auto calibration_span = std::chrono::milliseconds(10); // Span that fixes the ratio to about 1e-4.
+
+// The tick length once known for good; zero while it is still being estimated
+double fixed_tick(){
+#if defined(__x86_64__) || defined(__i386__)
+    // Linux reports the time stamp counter frequency on kernels that measured it at boot
+    std::ifstream file("/sys/devices/system/cpu/cpu0/tsc_freq_khz");
+    double khz = 0;
+    if(file >> khz && khz > 0){
+        return 1e-3 / khz;
+    }
+    return 0.0;
+#else
+    return 1e-9; // The fallback timer counts nanoseconds.
+#endif
+}
+std::atomic<double> seconds_per_tick{fixed_tick()};
+
+#if !defined(EDGE_DETECTOR_NO_STAGE_TIMERS)
+thread_local StageTicks* current_call = nullptr; // Call recorded on this thread.
+thread_local StageStats last_call; // Stats of the last outermost call on this thread.
+#endif
+}
+
+// Names as used in reports
+const char* stageName(Stage stage){
+    switch(stage){
+        case Stage::DECODE: return "DECODE";
+        case Stage::UNPACK: return "UNPACK";
+        case Stage::GRAYSCALE: return "GRAYSCALE";
+        case Stage::CONVOLUTION: return "CONVOLUTION";
+        case Stage::MAGNITUDE: return "MAGNITUDE";
+        case Stage::ZERO_CROSSINGS: return "ZERO_CROSSINGS";
+        case Stage::PACK: return "PACK";
+        case Stage::ENCODE: return "ENCODE";
+    }
+    return "UNKNOWN";
+}
+
+// The ratio of timer ticks to clock time since startup, measured without waiting. It is kept
+// for good once the span reaches calibration_span; earlier calls get a coarser estimate.
+double secondsPerTick(){
+    double fixed = seconds_per_tick.load(std::memory_order_relaxed);
+    if(fixed > 0){
+        return fixed;
+    }
+    std::uint64_t ticks = readTicks();
+    auto elapsed = std::chrono::steady_clock::now() - calibration_start.time;
+    std::uint64_t span = ticks - calibration_start.ticks;
+    double tick = std::chrono::duration<double>(elapsed).count() / static_cast<double>(span ? span : 1);
+    if(elapsed >= calibration_span){
+        seconds_per_tick.store(tick, std::memory_order_relaxed);
+    }
+    return tick;
+}
+
+// Sleeps out what is left of the calibration span, so the next reading fixes the ratio
+void calibrateTimer(){
+    if(seconds_per_tick.load(std::memory_order_relaxed) > 0){
+        return;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - calibration_start.time;
+    if(elapsed < calibration_span){
+        std::this_thread::sleep_for(calibration_span - elapsed);
+    }
+    secondsPerTick();
+}
+
+// Walk the buckets until the fraction of calls is reached
+double StageHistogram::percentile(double fraction) const {
+    if(calls == 0){
+        return 0.0;
+    }
+    double target = fraction * static_cast<double>(calls);
+    std::uint64_t seen = 0;
+    for(int b = 0; b < bucket_count; ++b){
+        seen += counts[b];
+        if(static_cast<double>(seen) >= target){
+            return std::ldexp(1.0, b + 1) * 1e-9;
+        }
+    }
+    return std::ldexp(1.0, bucket_count) * 1e-9;
+}
+
+// A snapshot of the counters; calls finishing meanwhile may be partly included
+StageHistogram stageHistogram(Stage stage){
+    const HistogramCounters& counters = histograms()[static_cast<int>(stage)];
+    StageHistogram histogram;
+    for(int b = 0; b < StageHistogram::bucket_count; ++b){
+        histogram.counts[b] = counters.counts[b].load(std::memory_order_relaxed);
+    }
+    histogram.calls = counters.calls.load(std::memory_order_relaxed);
+    histogram.total_seconds = counters.total_ns.load(std::memory_order_relaxed) * 1e-9;
+    return histogram;
+}
+
+// Zero every counter
+void resetStageHistograms(){
+    for(auto& counters : histograms()){
+        for(auto& count : counters.counts){
+            count.store(0, std::memory_order_relaxed);
+        }
+        counters.calls.store(0, std::memory_order_relaxed);
+        counters.total_ns.store(0, std::memory_order_relaxed);
+    }
+}
+
+#if !defined(EDGE_DETECTOR_NO_STAGE_TIMERS)
+// Only the outermost call on a thread records; nested calls add to it
+StageCall::StageCall(){
+    if(!current_call){
+        outermost = true;
+        current_call = &ticks;
+        start = readTicks();
+    }
+}
+
+// Convert the totals, keep them as the thread's last call and add them to the histograms
+StageCall::~StageCall(){
+    if(!outermost){
+        return;
+    }
+    std::uint64_t end = readTicks();
+    current_call = nullptr;
+    double tick = secondsPerTick();
+    last_call.wall_seconds = (end - start) * tick;
+    for(int s = 0; s < stage_count; ++s){
+        std::uint64_t n = ticks.ticks[s].load(std::memory_order_relaxed);
+        last_call.seconds[s] = n * tick;
+        if(n == 0){
+            continue;
+        }
+        auto ns = static_cast<std::uint64_t>(last_call.seconds[s] * 1e9);
+        int bucket = 0;
+        while(bucket + 1 < StageHistogram::bucket_count && (ns >> (bucket + 1)) != 0){
+            ++bucket;
+        }
+        HistogramCounters& counters = histograms()[s];
+        counters.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        counters.calls.fetch_add(1, std::memory_order_relaxed);
+        counters.total_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+}
+
+StageTicks* StageCall::current(){
+    return current_call;
+}
+
+const StageStats& StageCall::last(){
+    return last_call;
+}
+
+// Pool threads add to the call that started the loop for the duration of a band
+StageBinding::StageBinding(StageTicks* call) : previous(current_call){
+    current_call = call;
+}
+
+StageBinding::~StageBinding(){
+    current_call = previous;
+}
+#endif
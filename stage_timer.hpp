@@ -0,0 +1,197 @@
+#ifndef STAGE_TIMER_HPP
+#define STAGE_TIMER_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <array> // Per-stage counters.
+#include <atomic> // Counters shared by the threads of a call.
+#include <cstdint> // Tick counts.
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // Time stamp counter.
+#else
+#include <chrono> // Fallback clock.
+#endif
+
+// Stages of the pipeline that are timed.
+enum class Stage{
+    DECODE,         // PNG decoding in loadImage.
+    UNPACK,         // De-interleaving pixels into planes, with the grayscale conversion fused in, and the halos.
+    GRAYSCALE,      // Grayscale conversion of an image loaded without one.
+    CONVOLUTION,    // Gradient kernels and the LoG/DoG filters.
+    MAGNITUDE,      // Combining X and Y gradients into a magnitude.
+    ZERO_CROSSINGS, // Marking sign changes of a LoG or DoG response.
+    PACK,           // Converting planes or edge maps to bytes for saving.
+    ENCODE,         // PNG encoding.
+};
+
+constexpr int stage_count = 8; // Number of stages.
+const char* stageName(Stage stage); // Upper-case name of a stage.
+
+// Time spent in every stage by one call, summed over the threads that worked on it; a stage
+// running on 8 threads for 1 ms counts 8 ms. Wall time is the duration of the whole call.
+struct StageStats{
+    std::array<double, stage_count> seconds{}; // Seconds per stage.
+    double wall_seconds = 0; // Duration of the call.
+
+    double operator[](Stage stage) const { return seconds[static_cast<int>(stage)]; } // Seconds in one stage.
+};
+
+// Distribution of the time per call of one stage, over every call since the last reset.
+struct StageHistogram{
+    static constexpr int bucket_count = 40; // Bucket b holds times in [2^b, 2^(b+1)) ns; bucket 0 also holds shorter ones.
+
+    std::array<std::uint64_t, bucket_count> counts{}; // Calls per bucket.
+    std::uint64_t calls = 0; // Calls that ran the stage.
+    double total_seconds = 0; // Time in the stage over all those calls.
+
+    double mean() const { return calls ? total_seconds / calls : 0.0; } // Mean seconds per call.
+    double percentile(double fraction) const; // Upper edge, in seconds, of the bucket holding the given fraction of calls.
+};
+
+StageHistogram stageHistogram(Stage stage); // Cumulative histogram of a stage, over all threads.
+void resetStageHistograms(); // Clears every histogram.
+double secondsPerTick(); // Length of a timer tick, from the kernel or measured against the steady clock.
+void calibrateTimer(); // Fixes the tick length now, sleeping up to 10 ms after startup if it must be measured.
+
+// Reads the timer: the time stamp counter on x86, else the steady clock in nanoseconds.
+inline std::uint64_t readTicks(){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// Set while a trace is recorded (see trace.hpp); the timers then also record their stages.
+inline std::atomic<bool> trace_enabled{false};
+void traceStage(Stage stage, std::uint64_t begin, std::uint64_t end); // Records a stage event in the trace.
+
+// Building with EDGE_DETECTOR_NO_STAGE_TIMERS replaces the classes below with empty ones, so
+// the timers compile away entirely; getStageStats() then reports zeros.
+#if !defined(EDGE_DETECTOR_NO_STAGE_TIMERS)
+
+// Ticks per stage of the call in progress; threads of the call add to it concurrently.
+struct StageTicks{
+    std::array<std::atomic<std::uint64_t>, stage_count> ticks{}; // Ticks per stage.
+
+    void add(Stage stage, std::uint64_t n){ ticks[static_cast<int>(stage)].fetch_add(n, std::memory_order_relaxed); } // Adds ticks to a stage.
+};
+
+// StageCall marks a public call whose stages are recorded. Timers on the calling thread, and on
+// pool threads working for it through a StageBinding, add to the call; when the outermost
+// StageCall ends, the totals become the thread's last-call stats and go into the histograms.
+// Calls nested in a recorded call add to it instead.
+class StageCall{
+public:
+    StageCall(); // Starts recording, unless a call is already recorded on this thread.
+    ~StageCall(); // Publishes the stats of an outermost call.
+
+    StageCall(const StageCall&) = delete;
+    StageCall& operator=(const StageCall&) = delete;
+
+    static StageTicks* current(); // Call recorded on this thread, null if none.
+    static const StageStats& last(); // Stats of this thread's last recorded call.
+
+private:
+    StageTicks ticks; // Totals of this call.
+    std::uint64_t start = 0; // Ticks at the start of the call.
+    bool outermost = false; // False for a nested call.
+};
+
+// StageBinding lets a pool thread add to the call that started a parallel loop.
+class StageBinding{
+public:
+    explicit StageBinding(StageTicks* call); // Records into the call until destroyed.
+    ~StageBinding(); // Restores the thread's previous call.
+
+    StageBinding(const StageBinding&) = delete;
+    StageBinding& operator=(const StageBinding&) = delete;
+
+private:
+    StageTicks* previous; // Call recorded before the binding.
+};
+
+// StageLap splits a block into consecutive stages: lap(stage) charges the time since the
+// previous lap (or construction) to the stage. Laps add to local counters that reach the
+// call once, on destruction, so a lap costs one timer read. While tracing, the block is
+// recorded as one trace event per stage, laid end to end from the start of the block in
+// stage order with the summed times, so a loop alternating stages per column stays a few events.
+class StageLap{
+public:
+    StageLap() : call(StageCall::current()), traced(trace_enabled.load(std::memory_order_relaxed)), start(call || traced ? readTicks() : 0), mark(start){}
+    ~StageLap(){
+        std::uint64_t begin = start;
+        for(int s = 0; s < stage_count; ++s){
+            if(local[s]){
+                if(call){
+                    call->add(static_cast<Stage>(s), local[s]);
+                }
+                if(traced){
+                    traceStage(static_cast<Stage>(s), begin, begin + local[s]);
+                    begin += local[s];
+                }
+            }
+        }
+    }
+
+    StageLap(const StageLap&) = delete;
+    StageLap& operator=(const StageLap&) = delete;
+
+    // Charges the time since the last lap to a stage.
+    void lap(Stage stage){
+        if(call || traced){
+            std::uint64_t now = readTicks();
+            local[static_cast<int>(stage)] += now - mark;
+            mark = now;
+        }
+    }
+
+private:
+    StageTicks* call; // Call recorded on this thread, null if none.
+    bool traced; // True if tracing was on when the lap started.
+    std::uint64_t start; // Ticks at construction.
+    std::uint64_t mark; // Ticks at the last lap.
+    std::array<std::uint64_t, stage_count> local{}; // Ticks per stage not yet added to the call or the trace.
+};
+
+// StageScope charges the time until the end of the scope to one stage.
+class StageScope{
+public:
+    explicit StageScope(Stage stage) : stage(stage){}
+    ~StageScope(){ timer.lap(stage); }
+
+private:
+    Stage stage; // Stage being timed.
+    StageLap timer; // Started after stage is set.
+};
+
+#else
+
+struct StageTicks{};
+
+class StageCall{
+public:
+    StageCall(){}
+    ~StageCall(){}
+    static StageTicks* current(){ return nullptr; }
+    static const StageStats& last(){ static const StageStats none; return none; }
+};
+
+class StageBinding{
+public:
+    explicit StageBinding(StageTicks*){}
+};
+
+class StageLap{
+public:
+    void lap(Stage){}
+};
+
+class StageScope{
+public:
+    explicit StageScope(Stage){}
+};
+
+#endif
+
+#endif // STAGE_TIMER_HPP
@@ -0,0 +1,643 @@
+#include "edge_detector.hpp"
+#include "frame_ring.hpp"
+#include "deadline_scheduler.hpp"
+#if defined(__cpp_impl_coroutine)
+#include "async_detector.hpp"
+#endif
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+// Checks that the alternative paths of the library agree with each other: strips with whole-image
+// runs, bit masks with run-length masks and edge lists, every parallel backend with the serial
+// one, grey with alpha with plain grey; that the frame ring counts what it drops and blocks on;
+// and that frames after the first make no heap allocations. Images are synthetic, so the tests need no files.
+// Usage: tests (prints every failed check and exits with 1 if there was one)
+
+namespace {
+int failures = 0; // Failed checks so far.
+
+// Reports a failed check with the test and condition that failed
+void check(bool condition, const char* test, const char* what){
+    if(!condition){
+        std::cerr << test << ": " << what << " failed" << std::endl;
+        ++failures;
+    }
+}
+
+#define CHECK(test, condition) check((condition), (test), #condition)
+
+std::atomic<bool> counting_allocations{false}; // Set while heap allocations are counted.
+std::atomic<std::size_t> heap_allocations{0}; // Calls of operator new, by any thread, while counting.
+
+// Counts a call of operator new if counting is on
+void count_heap_allocation(){
+    if(counting_allocations.load(std::memory_order_relaxed)){
+        heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+}
+
+// The replaced allocation functions count every allocation of the program, the library's included
+void* operator new(std::size_t size){
+    count_heap_allocation();
+    if(void* p = std::malloc(size ? size : 1)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment){
+    count_heap_allocation();
+    std::size_t align = static_cast<std::size_t>(alignment);
+    if(void* p = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// GCC sees free() reached from a delete-expression once this is inlined and warns, although
+// every operator new here allocates with malloc
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept { std::free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+void operator delete(void* p, std::size_t) noexcept { ::operator delete(p); }
+void operator delete(void* p, std::align_val_t) noexcept { ::operator delete(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { ::operator delete(p); }
+
+namespace {
+
+// Interleaved 8-bit pixels of discs on gradients with a little noise, as in the benchmark
+std::vector<unsigned char> synthetic(int width, int height, int channels){
+    std::vector<unsigned char> pixels(static_cast<std::size_t>(width) * height * channels);
+    int cell = 24;
+    for(int i = 0; i < height; ++i){
+        for(int j = 0; j < width; ++j){
+            int di = i % cell - cell / 2;
+            int dj = j % cell - cell / 2;
+            bool disc = di * di + dj * dj < cell * cell / 9;
+            unsigned int noise = (static_cast<unsigned int>(i) * 2654435761u ^ static_cast<unsigned int>(j) * 40503u) >> 28;
+            unsigned char* pixel = &pixels[(static_cast<std::size_t>(i) * width + j) * channels];
+            for(int c = 0; c < channels; ++c){
+                pixel[c] = static_cast<unsigned char>((disc ? 200 - 60 * c : 255 * (c % 2 ? i : j) / width) + noise);
+            }
+        }
+    }
+    return pixels;
+}
+
+// Decodes pixels into a detector, honouring its memory budget
+bool load(EdgeDetector& detector, const std::vector<unsigned char>& pixels, int width, int height, int channels){
+    auto image = std::make_shared<EdgeDetector::ImageData>();
+    return detector.fillImage(*image, pixels.data(), width, height, channels) && detector.setImage(image);
+}
+
+const int width = 203; // Test image width; not a multiple of the SIMD width or of 64.
+const int height = 157; // Test image height.
+
+const std::vector<EdgeDetector::DetectorType> detectors = {
+    EdgeDetector::DetectorType::SOBEL, EdgeDetector::DetectorType::PREWITT, EdgeDetector::DetectorType::ROBERTSCROSS,
+    EdgeDetector::DetectorType::LOG, EdgeDetector::DetectorType::DOG,
+};
+const std::vector<EdgeDetector::GradientType> directions = {
+    EdgeDetector::GradientType::X, EdgeDetector::GradientType::Y, EdgeDetector::GradientType::MAG,
+};
+
+// A memory budget forcing strips gives the same edges and thresholds as a whole-image run
+void strips_match_whole(){
+    const char* test = "strips_match_whole";
+    // Tall and narrow, so that the column padding of the planes leaves room for a few strips below
+    const int strip_width = 71, strip_height = 600;
+    auto pixels = synthetic(strip_width, strip_height, 1);
+    EdgeDetector whole;
+    CHECK(test, load(whole, pixels, strip_width, strip_height, 1));
+    for(auto detector_type : detectors){
+        for(auto direction : directions){
+            EdgeDetector::Matrix expected = whole.applyDetector(detector_type, direction);
+            auto expected_threshold = whole.applyDetector(detector_type, direction, EdgeDetector::ThresholdType::OTSU);
+            EdgeDetector::MemoryStats stats = whole.getMemoryStats();
+
+            // LoG and DoG get a quarter of their whole-image temporaries. Gradient detectors have none,
+            // so they get a byte less than the image with its grayscale plane, which leaves the
+            // grayscale rows of a few strips
+            EdgeDetector striped;
+            if(stats.scratch_bytes > 0){
+                striped.setMemoryBudget(stats.image_bytes + stats.output_bytes + stats.scratch_bytes / 4);
+            } else {
+                striped.setMemoryBudget(stats.image_bytes - 1);
+            }
+            CHECK(test, load(striped, pixels, strip_width, strip_height, 1));
+            EdgeDetector::Matrix edges = striped.applyDetector(detector_type, direction);
+            CHECK(test, striped.getMemoryStats().strips > 1);
+            CHECK(test, edges == expected);
+            auto threshold = striped.applyDetector(detector_type, direction, EdgeDetector::ThresholdType::OTSU);
+            CHECK(test, threshold.threshold == expected_threshold.threshold);
+        }
+    }
+}
+
+// Bit masks, run-length masks and edge lists mark the same pixels as thresholding the dense output
+void masks_agree(){
+    const char* test = "masks_agree";
+    auto pixels = synthetic(width, height, 3);
+    EdgeDetector detector;
+    CHECK(test, load(detector, pixels, width, height, 3));
+    for(auto detector_type : detectors){
+        double threshold = detector_type == EdgeDetector::DetectorType::LOG || detector_type == EdgeDetector::DetectorType::DOG ? 1.0 : 100.0;
+        EdgeDetector::Matrix dense = detector.applyDetector(detector_type, EdgeDetector::GradientType::MAG);
+        BitMask mask = detector.applyDetectorMask(detector_type, EdgeDetector::GradientType::MAG, threshold);
+        RunLengthMask rle = detector.applyDetectorRLE(detector_type, EdgeDetector::GradientType::MAG, threshold);
+        EdgeDetector::EdgeList sparse = detector.applyDetectorSparse(detector_type, threshold);
+
+        std::size_t expected = (dense.array().abs() > threshold).count();
+        CHECK(test, expected > 0);
+        CHECK(test, mask.count() == expected);
+        CHECK(test, rle.count() == expected);
+        CHECK(test, sparse.size() == expected);
+        bool same = true;
+        for(int i = 0; i < height; ++i){
+            for(int j = 0; j < width; ++j){
+                bool set = std::abs(dense(i, j)) > threshold;
+                same = same && mask.get(i, j) == set && rle.get(i, j) == set;
+            }
+        }
+        CHECK(test, same);
+        bool listed = true;
+        for(std::size_t k = 0; k < sparse.size(); ++k){
+            listed = listed && mask.get(sparse.y[k], sparse.x[k]);
+            listed = listed && (k == 0 || sparse.y[k - 1] < sparse.y[k] || (sparse.y[k - 1] == sparse.y[k] && sparse.x[k - 1] < sparse.x[k]));
+        }
+        CHECK(test, listed);
+        BitMask decoded = rle.toBitMask();
+        CHECK(test, decoded.count() == expected);
+        CHECK(test, RunLengthMask::fromBitMask(mask).runCount() == rle.runCount());
+    }
+
+    // The thresholded mask agrees with its own edges and keeps its buffers from call to call
+    EdgeDetector::ThresholdResult result;
+    CHECK(test, detector.applyDetector(EdgeDetector::DetectorType::SOBEL, EdgeDetector::GradientType::MAG,
+                                       EdgeDetector::ThresholdType::OTSU, result, 0.9, true));
+    const unsigned char* mask_data = result.mask.data();
+    CHECK(test, detector.applyDetector(EdgeDetector::DetectorType::PREWITT, EdgeDetector::GradientType::MAG,
+                                       EdgeDetector::ThresholdType::OTSU, result, 0.9, true));
+    CHECK(test, result.mask.data() == mask_data);
+    bool thresholded = result.mask.rows() == height && result.mask.cols() == width;
+    for(int i = 0; thresholded && i < height; ++i){
+        for(int j = 0; j < width; ++j){
+            thresholded = thresholded && result.mask(i, j) == (std::abs(result.edges(i, j)) > result.threshold ? 255 : 0);
+        }
+    }
+    CHECK(test, thresholded);
+}
+
+// Sparse LoG and DoG list the same pixels as the dense output, and their scratch depends on the
+// width only: an image twice as tall needs no more. Each run is on a fresh thread, so its
+// workspace starts empty
+void sparse_strips_bounded(){
+    const char* test = "sparse_strips_bounded";
+    const int tall_width = 64;
+    for(auto detector_type : {EdgeDetector::DetectorType::LOG, EdgeDetector::DetectorType::DOG}){
+        std::size_t held[2] = {0, 0};
+        for(int k = 0; k < 2; ++k){
+            int tall_height = 1200 * (k + 1);
+            auto pixels = synthetic(tall_width, tall_height, 1);
+            EdgeDetector detector;
+            CHECK(test, load(detector, pixels, tall_width, tall_height, 1));
+            EdgeDetector::Matrix dense = detector.applyDetector(detector_type, EdgeDetector::GradientType::MAG);
+            EdgeDetector::EdgeList sparse;
+            std::thread worker([&]{
+                sparse = detector.applyDetectorSparse(detector_type, 1.0);
+                held[k] = Workspace::forThread().heldBytes();
+            });
+            worker.join();
+            CHECK(test, sparse.size() == static_cast<std::size_t>((dense.array().abs() > 1.0).count()));
+            bool listed = true;
+            for(std::size_t n = 0; n < sparse.size(); ++n){
+                listed = listed && std::abs(dense(sparse.y[n], sparse.x[n])) == sparse.magnitude[n];
+            }
+            CHECK(test, listed);
+            if(k == 1){
+                CHECK(test, held[1] < static_cast<std::size_t>(dense.size()) * sizeof(double));
+            }
+        }
+        CHECK(test, held[0] > 0 && held[1] == held[0]);
+    }
+}
+
+// A saved run-length mask loads back unchanged
+void rle_round_trip(){
+    const char* test = "rle_round_trip";
+    auto pixels = synthetic(width, height, 3);
+    EdgeDetector detector;
+    CHECK(test, load(detector, pixels, width, height, 3));
+    RunLengthMask rle = detector.applyDetectorRLE(EdgeDetector::DetectorType::SOBEL, EdgeDetector::GradientType::MAG, 100.0);
+    std::string filename = "tests_round_trip.rle";
+    CHECK(test, rle.save(filename));
+    RunLengthMask loaded;
+    CHECK(test, loaded.load(filename));
+    std::remove(filename.c_str());
+    CHECK(test, loaded.rows() == rle.rows() && loaded.cols() == rle.cols());
+    CHECK(test, loaded.runCount() == rle.runCount());
+    bool same = loaded.runCount() == rle.runCount();
+    for(int r = 0; r < rle.rows() && same; ++r){
+        same = loaded.rowEnd(r) - loaded.rowBegin(r) == rle.rowEnd(r) - rle.rowBegin(r);
+        for(const RunLengthMask::Run *a = rle.rowBegin(r), *b = loaded.rowBegin(r); same && a != rle.rowEnd(r); ++a, ++b){
+            same = a->start == b->start && a->length == b->length;
+        }
+    }
+    CHECK(test, same);
+}
+
+// Writes a run-length mask file from its parts, as RunLengthMask::save lays it out
+void write_rle(const std::string& filename, std::int32_t rows, std::int32_t cols, std::uint64_t n_runs,
+               const std::vector<std::uint64_t>& offsets, const std::vector<RunLengthMask::Run>& runs){
+    std::ofstream file(filename, std::ios::binary);
+    std::int32_t shape[2] = {rows, cols};
+    file.write("RLE1", 4);
+    file.write(reinterpret_cast<const char*>(shape), sizeof(shape));
+    file.write(reinterpret_cast<const char*>(&n_runs), sizeof(n_runs));
+    file.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(std::uint64_t));
+    file.write(reinterpret_cast<const char*>(runs.data()), runs.size() * sizeof(RunLengthMask::Run));
+}
+
+// Damaged files are rejected and leave the mask unchanged
+void rle_rejects_malformed(){
+    const char* test = "rle_rejects_malformed";
+    std::string filename = "tests_malformed.rle";
+    // Two rows of eight columns: runs [1, 3) and [5, 8) in row 0, none in row 1
+    write_rle(filename, 2, 8, 2, {0, 2, 2}, {{1, 2}, {5, 3}});
+    RunLengthMask mask;
+    CHECK(test, mask.load(filename));
+    CHECK(test, mask.count() == 5);
+
+    struct Case{
+        const char* what; // What is wrong with the file.
+        std::int32_t rows, cols; // Header shape.
+        std::uint64_t n_runs; // Header run count.
+        std::vector<std::uint64_t> offsets; // Row index.
+        std::vector<RunLengthMask::Run> runs; // Runs.
+    };
+    const std::vector<Case> cases = {
+        {"rows beyond the file", 1 << 30, 8, 2, {0, 2, 2}, {{1, 2}, {5, 3}}},
+        {"runs beyond the file", 2, 8, std::uint64_t(1) << 60, {0, 2, 2}, {{1, 2}, {5, 3}}},
+        {"negative size", -2, 8, 2, {0, 2, 2}, {{1, 2}, {5, 3}}},
+        {"offsets decrease", 2, 8, 2, {0, 3, 2}, {{1, 2}, {5, 3}}},
+        {"offset past the runs", 3, 8, 2, {0, 3, 1, 2}, {{1, 2}, {5, 3}}},
+        {"run past the row", 2, 8, 2, {0, 2, 2}, {{1, 2}, {5, 4}}},
+        {"run start overflows", 2, 8, 2, {0, 2, 2}, {{1, 2}, {0xFFFFFFFFu, 2}}},
+        {"runs overlap", 2, 8, 2, {0, 2, 2}, {{1, 5}, {5, 3}}},
+        {"runs unsorted", 2, 8, 2, {0, 2, 2}, {{5, 3}, {1, 2}}},
+    };
+    for(const Case& bad : cases){
+        write_rle(filename, bad.rows, bad.cols, bad.n_runs, bad.offsets, bad.runs);
+        bool loaded = mask.load(filename);
+        check(!loaded, test, bad.what);
+        check(mask.rows() == 2 && mask.cols() == 8 && mask.count() == 5, test, bad.what);
+    }
+    // Cut short inside the runs
+    write_rle(filename, 2, 8, 2, {0, 2, 2}, {{1, 2}});
+    CHECK(test, !mask.load(filename));
+    std::remove(filename.c_str());
+}
+
+// The serial backend and the pool give bit-identical results
+void backends_match(){
+    const char* test = "backends_match";
+    auto pixels = synthetic(width, height, 3);
+    ParallelBackend previous = parallelBackend();
+    std::vector<ParallelBackend> backends;
+    for(ParallelBackend backend : {ParallelBackend::POOL, ParallelBackend::OPENMP, ParallelBackend::STD_EXECUTION}){
+        if(parallelBackendAvailable(backend)){
+            backends.push_back(backend);
+        }
+    }
+    for(auto detector_type : detectors){
+        for(auto direction : directions){
+            CHECK(test, setParallelBackend(ParallelBackend::SERIAL));
+            EdgeDetector serial;
+            CHECK(test, load(serial, pixels, width, height, 3));
+            EdgeDetector::Matrix expected = serial.applyDetector(detector_type, direction);
+            for(ParallelBackend backend : backends){
+                CHECK(test, setParallelBackend(backend));
+                EdgeDetector parallel;
+                CHECK(test, load(parallel, pixels, width, height, 3));
+                CHECK(test, parallel.applyDetector(detector_type, direction) == expected);
+                // Batches nest the loops of every image inside the loop over the images
+                auto batch = parallel.applyDetectorBatch({parallel.getImage(), parallel.getImage()}, detector_type, direction);
+                CHECK(test, batch.size() == 2 && batch[0] == expected && batch[1] == expected);
+            }
+        }
+    }
+    setParallelBackend(previous);
+}
+
+// Grey with alpha loads, detects on the grey channel and keeps both channels for per-channel detection
+void grey_alpha_loads(){
+    const char* test = "grey_alpha_loads";
+    auto pixels = synthetic(width, height, 2);
+    std::vector<unsigned char> grey(static_cast<std::size_t>(width) * height);
+    for(std::size_t k = 0; k < grey.size(); ++k){
+        grey[k] = pixels[2 * k];
+    }
+    EdgeDetector with_alpha, without_alpha;
+    CHECK(test, load(with_alpha, pixels, width, height, 2));
+    CHECK(test, load(without_alpha, grey, width, height, 1));
+    for(auto detector_type : detectors){
+        CHECK(test, with_alpha.applyDetector(detector_type, EdgeDetector::GradientType::MAG) == without_alpha.applyDetector(detector_type, EdgeDetector::GradientType::MAG));
+    }
+    CHECK(test, with_alpha.applyDetectorPerChannel(EdgeDetector::DetectorType::SOBEL, EdgeDetector::GradientType::MAG).size() == 2);
+    CHECK(test, with_alpha.applyColorDetector(EdgeDetector::DetectorType::SOBEL).magnitude.size() == width * height);
+}
+
+// Nodes keep their kernel numbers when the numbering has gaps
+void numa_node_ids(){
+    const char* test = "numa_node_ids";
+    NumaTopology topology;
+    topology.nodes = {{0, 1}, {4, 5}};
+    topology.ids = {0, 2};
+    CHECK(test, topology.nodeOfCpu(5) == 2);
+    CHECK(test, topology.nodeOfCpu(1) == 0);
+    CHECK(test, topology.nodeOfCpu(3) == -1);
+    CHECK(test, topology.indexOf(2) == 1);
+    CHECK(test, topology.indexOf(1) == -1);
+    const NumaTopology& system = NumaTopology::system();
+    CHECK(test, system.ids.size() == system.nodes.size());
+    CHECK(test, system.indexOf(system.ids.back()) == system.size() - 1);
+}
+
+// Frames of changing sizes keep one buffer per workspace slot, and under a memory budget the
+// workspace gives back what the detector no longer uses
+void workspace_bounded(){
+    const char* test = "workspace_bounded";
+    Workspace& workspace = Workspace::forThread();
+    workspace.clear();
+    std::size_t largest = 0;
+    for(int size : {64, 96, 128, 96, 64, 128}){
+        auto pixels = synthetic(size, size, 3);
+        EdgeDetector detector;
+        CHECK(test, load(detector, pixels, size, size, 3));
+        detector.applyDetector(EdgeDetector::DetectorType::LOG, EdgeDetector::GradientType::MAG);
+        if(size == 128 && largest == 0){
+            largest = workspace.heldBytes();
+        }
+    }
+    CHECK(test, largest > 0);
+    CHECK(test, workspace.heldBytes() == largest);
+
+    // Room for a quarter of the whole-image temporaries. Buffers requested since the last budgeted
+    // call are kept by the next one, so the whole-image buffers go after the second budgeted
+    // call, and strip-sized ones take their place in the third
+    auto pixels = synthetic(width, height, 1);
+    EdgeDetector detector;
+    CHECK(test, load(detector, pixels, width, height, 1));
+    detector.applyDetector(EdgeDetector::DetectorType::LOG, EdgeDetector::GradientType::MAG);
+    EdgeDetector::MemoryStats stats = detector.getMemoryStats();
+    std::size_t allowance = stats.scratch_bytes / 4;
+    detector.setMemoryBudget(stats.image_bytes + stats.output_bytes + allowance);
+    EdgeDetector::Matrix edges;
+    detector.applyDetector(EdgeDetector::DetectorType::LOG, EdgeDetector::GradientType::MAG, edges);
+    CHECK(test, detector.getMemoryStats().strips > 1);
+    detector.applyDetector(EdgeDetector::DetectorType::LOG, EdgeDetector::GradientType::MAG, edges);
+    detector.applyDetector(EdgeDetector::DetectorType::LOG, EdgeDetector::GradientType::MAG, edges);
+    CHECK(test, workspace.heldBytes() <= allowance);
+    // Later frames reuse what is left
+    workspace.resetCounters();
+    detector.applyDetector(EdgeDetector::DetectorType::LOG, EdgeDetector::GradientType::MAG, edges);
+    CHECK(test, workspace.allocationCount() == 0);
+}
+
+// Once a frame of a size has been processed, loading and detecting more frames of that size
+// allocates nothing on any thread: the image is filled in place, scratch comes from the
+// workspaces and the pool's loops live on the stack
+void steady_state_allocation_free(){
+    const char* test = "steady_state_allocation_free";
+    auto pixels = synthetic(width, height, 3);
+    EdgeDetector detector;
+    auto image = std::make_shared<EdgeDetector::ImageData>();
+    EdgeDetector::Matrix edges;
+    for(auto detector_type : {EdgeDetector::DetectorType::SOBEL, EdgeDetector::DetectorType::LOG}){
+        auto frame = [&]{
+            return detector.fillImage(*image, pixels.data(), width, height, 3) && detector.setImage(image)
+                   && detector.applyDetector(detector_type, EdgeDetector::GradientType::MAG, edges);
+        };
+        // Warm-up: buffers, thread-local state and the pool's task queues reach their size
+        for(int k = 0; k < 3; ++k){
+            CHECK(test, frame());
+        }
+        heap_allocations = 0;
+        counting_allocations = true;
+        bool processed = true;
+        for(int k = 0; k < 5; ++k){
+            processed = frame() && processed;
+        }
+        counting_allocations = false;
+        CHECK(test, processed);
+        CHECK(test, heap_allocations.load() == 0);
+    }
+}
+
+// A full drop-oldest ring drops one frame per commit; a blocking ring drops nothing
+void frame_ring_counts(){
+    const char* test = "frame_ring_counts";
+    FrameRing dropping(2, 16, 8, 1, FramePolicy::DROP_OLDEST);
+    for(int k = 0; k < 5; ++k){
+        dropping.frame().width = 16 + k; // Tags the frame
+        CHECK(test, dropping.commit());
+    }
+    CHECK(test, dropping.committedCount() == 5);
+    CHECK(test, dropping.droppedCount() == 3);
+    CHECK(test, dropping.occupancy() == 2);
+    dropping.close();
+    auto frame = dropping.read();
+    CHECK(test, frame && frame->width == 19);
+    frame = dropping.read();
+    CHECK(test, frame && frame->width == 20);
+    CHECK(test, !dropping.read());
+    CHECK(test, dropping.consumedCount() == 2);
+
+    // The producer runs ahead and has to wait for the consumer on every frame after the first two
+    const int n_frames = 200;
+    FrameRing blocking(2, 16, 8, 1, FramePolicy::BLOCK);
+    std::thread producer([&]{
+        for(int k = 0; k < n_frames; ++k){
+            blocking.frame().width = k;
+            blocking.commit();
+        }
+        blocking.close();
+    });
+    bool in_order = true;
+    int n_read = 0;
+    while(auto next = blocking.read()){
+        in_order = in_order && next->width == n_read;
+        ++n_read;
+        CHECK(test, blocking.occupancy() <= 2);
+    }
+    producer.join();
+    CHECK(test, in_order);
+    CHECK(test, n_read == n_frames);
+    CHECK(test, blocking.committedCount() == n_frames);
+    CHECK(test, blocking.consumedCount() == n_frames);
+    CHECK(test, blocking.droppedCount() == 0);
+}
+
+// Each pyramid level is the 5x5 binomial blur of the one before, sampled at even pixels, with
+// pixels outside the level read through the detector's border policy
+void pyramid_border_policy(){
+    const char* test = "pyramid_border_policy";
+    auto pixels = synthetic(width, height, 1);
+    const double constant = 40.0;
+    const double weights[5] = {1.0 / 16, 4.0 / 16, 6.0 / 16, 4.0 / 16, 1.0 / 16};
+    for(auto policy : {BorderPolicy::REPLICATE, BorderPolicy::REFLECT, BorderPolicy::CONSTANT}){
+        EdgeDetector detector;
+        detector.setBorderPolicy(policy, constant);
+        CHECK(test, load(detector, pixels, width, height, 1));
+        PlaneStack pyramid;
+        detector.applyDetectorPyramid(EdgeDetector::DetectorType::SOBEL, EdgeDetector::GradientType::MAG, 3, &pyramid);
+        CHECK(test, pyramid.size() == 3);
+        for(int level = 1; level < pyramid.size(); ++level){
+            auto fine = pyramid[level - 1];
+            auto coarse = pyramid[level];
+            auto pixel = [&](int i, int j){
+                bool inside = i >= 0 && i < fine.rows() && j >= 0 && j < fine.cols();
+                if(policy == BorderPolicy::CONSTANT && !inside){
+                    return constant;
+                }
+                return fine(BasicPlaneView<double>::border_index(i, static_cast<int>(fine.rows()), policy),
+                            BasicPlaneView<double>::border_index(j, static_cast<int>(fine.cols()), policy));
+            };
+            double worst = 0;
+            for(int i = 0; i < coarse.rows(); ++i){
+                for(int j = 0; j < coarse.cols(); ++j){
+                    double sum = 0;
+                    for(int dy = 0; dy < 5; ++dy){
+                        for(int dx = 0; dx < 5; ++dx){
+                            sum += weights[dy] * weights[dx] * pixel(2 * i + dy - 2, 2 * j + dx - 2);
+                        }
+                    }
+                    worst = std::max(worst, std::abs(sum - coarse(i, j)));
+                }
+            }
+            CHECK(test, worst < 1e-9);
+        }
+    }
+}
+
+// An image handed over as const is copied before a new border policy is written, even when
+// the detector holds its last reference; one the detector loaded itself is refilled in place
+void const_image_copied(){
+    const char* test = "const_image_copied";
+    auto pixels = synthetic(width, height, 1);
+    EdgeDetector detector;
+    EdgeDetector::ImageData filled;
+    CHECK(test, detector.fillImage(filled, pixels.data(), width, height, 1));
+    auto image = std::make_shared<const EdgeDetector::ImageData>(std::move(filled));
+    std::weak_ptr<const EdgeDetector::ImageData> original = image;
+    CHECK(test, detector.setImage(std::move(image)));
+    detector.setBorderPolicy(BorderPolicy::CONSTANT, 7.0);
+    CHECK(test, original.expired());
+    CHECK(test, detector.getImage()->hasBorder(BorderPolicy::CONSTANT, 7.0));
+
+    // Now the image is the detector's own copy, so the next policy needs no other
+    const EdgeDetector::ImageData* own = detector.getImage().get();
+    detector.setBorderPolicy(BorderPolicy::REFLECT);
+    CHECK(test, detector.getImage().get() == own);
+    CHECK(test, detector.getImage()->hasBorder(BorderPolicy::REFLECT, 0.0));
+}
+
+// A null frame fails its own future without being queued; frames after it still run
+void deadline_rejects_empty_frame(){
+    const char* test = "deadline_rejects_empty_frame";
+    DeadlineScheduler scheduler;
+    auto deadline = DeadlineScheduler::Clock::now() + std::chrono::seconds(10);
+    auto rejected = scheduler.submit(nullptr, EdgeDetector::DetectorType::SOBEL, EdgeDetector::GradientType::MAG, deadline);
+    bool threw = false;
+    try{
+        rejected.get();
+    } catch(const std::invalid_argument&){
+        threw = true;
+    }
+    CHECK(test, threw);
+
+    auto pixels = synthetic(width, height, 1);
+    auto image = std::make_shared<EdgeDetector::ImageData>();
+    CHECK(test, EdgeDetector().fillImage(*image, pixels.data(), width, height, 1));
+    auto result = scheduler.submit(image, EdgeDetector::DetectorType::SOBEL, EdgeDetector::GradientType::MAG, deadline).get();
+    CHECK(test, result.frame == 0);
+    CHECK(test, result.quality == FrameQuality::FULL);
+    CHECK(test, result.edges.rows() == height && result.edges.cols() == width);
+    CHECK(test, scheduler.missedCount() == 0);
+}
+
+#if defined(__cpp_impl_coroutine)
+// Coroutine started on the spot and never awaited, enough to drive an awaitable
+struct Detached{
+    struct promise_type{
+        Detached get_return_object(){ return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void(){}
+        void unhandled_exception(){ std::terminate(); }
+    };
+};
+
+// Sets outcome to 1 if the awaited job returned, 2 if its exception reached the coroutine
+Detached await_throwing_job(std::atomic<int>& outcome){
+    try{
+        co_await PoolAwaitable<int>([]() -> int { throw std::runtime_error("job failed"); });
+        outcome = 1;
+    } catch(const std::runtime_error&){
+        outcome = 2;
+    }
+}
+
+// A job that throws resumes its caller, which sees the exception at co_await
+void async_job_exception(){
+    const char* test = "async_job_exception";
+    std::atomic<int> outcome{0};
+    await_throwing_job(outcome);
+    auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while(outcome == 0 && std::chrono::steady_clock::now() < give_up){
+        std::this_thread::yield();
+    }
+    CHECK(test, outcome == 2);
+}
+#endif
+}
+
+int main(){
+    const std::vector<std::pair<const char*, void (*)()>> tests = {
+        {"strips_match_whole", strips_match_whole},
+        {"masks_agree", masks_agree},
+        {"sparse_strips_bounded", sparse_strips_bounded},
+        {"rle_round_trip", rle_round_trip},
+        {"rle_rejects_malformed", rle_rejects_malformed},
+        {"backends_match", backends_match},
+        {"grey_alpha_loads", grey_alpha_loads},
+        {"numa_node_ids", numa_node_ids},
+        {"workspace_bounded", workspace_bounded},
+        {"steady_state_allocation_free", steady_state_allocation_free},
+        {"frame_ring_counts", frame_ring_counts},
+        {"pyramid_border_policy", pyramid_border_policy},
+        {"const_image_copied", const_image_copied},
+        {"deadline_rejects_empty_frame", deadline_rejects_empty_frame},
+#if defined(__cpp_impl_coroutine)
+        {"async_job_exception", async_job_exception},
+#endif
+    };
+    for(const auto& [name, run] : tests){
+        int before = failures;
+        run();
+        std::cout << (failures == before ? "passed " : "FAILED ") << name << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,280 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "trace.hpp"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+// The pool and deque index of the running worker thread
+thread_local ThreadPool* current_pool = nullptr;
+thread_local int current_index = -1;
+std::atomic<int> pools_created{0}; // Numbers the pools in creation order.
+
+// CPUs for the shared pool: every allowed CPU, node by node, if the environment asks for pinning
+std::vector<int> shared_pool_cpus(){
+    const char* pin = std::getenv("EDGE_DETECTOR_PIN_THREADS");
+    if(pin && std::strcmp(pin, "0") != 0){
+        return NumaTopology::system().cpus();
+    }
+    return {};
+}
+
+// Restrict the calling thread to one CPU; a failure leaves the thread unpinned
+void pin_thread(int cpu){
+#if defined(__linux__)
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    if(pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) != 0){
+        std::cerr << "Could not pin worker thread to CPU " << cpu << std::endl;
+    }
+#else
+    (void)cpu;
+#endif
+}
+}
+
+// Progress of one parallelFor call, on the caller's stack and shared by every task it spawns.
+// The caller returns only once remaining is 0, and every task of the loop has been taken
+// from the deques by then, so no task outlives the state.
+struct ThreadPool::LoopState{
+    FunctionRef<void(int, int)> body; // Loop body, owned by the waiting caller.
+    int grain; // Ranges up to this size run without splitting.
+    std::atomic<int> remaining; // Items not finished yet.
+    std::atomic<int> pending{0}; // Tasks of the loop waiting in the deques.
+};
+
+// Start the requested number of workers (at least one), each with its own deque
+ThreadPool::ThreadPool(unsigned int n_threads){
+    start(n_threads);
+}
+
+// Same, with the workers pinned to the CPUs in turn
+ThreadPool::ThreadPool(unsigned int n_threads, std::vector<int> cpus) : cpus(std::move(cpus)){
+    start(n_threads);
+}
+
+// Deques first: a worker may steal from any deque as soon as it runs
+void ThreadPool::start(unsigned int n_threads){
+    n_threads = std::max(1u, n_threads);
+    number = pools_created.fetch_add(1);
+    for(unsigned int t = 0; t < n_threads; ++t){
+        queues.push_back(std::make_unique<WorkerQueue>());
+        // Room for the halves of a few nested loops, so pushing seldom has to grow a deque
+        queues.back()->tasks.reserve(64);
+    }
+    for(unsigned int t = 0; t < n_threads; ++t){
+        workers.emplace_back(&ThreadPool::worker_loop, this, t);
+    }
+}
+
+// Signal shutdown and wait for every worker to finish
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    for(auto& worker : workers){
+        worker.join();
+    }
+}
+
+// The shared pool is created on first use; a pinned pool has one worker per allowed CPU
+ThreadPool& ThreadPool::instance(){
+    static std::vector<int> cpus = shared_pool_cpus();
+    static ThreadPool pool(cpus.empty() ? std::thread::hardware_concurrency() : static_cast<unsigned int>(cpus.size()), cpus);
+    return pool;
+}
+
+// Node pools are created on first use and live as long as the process
+ThreadPool& ThreadPool::forNode(int node){
+    const NumaTopology& topology = NumaTopology::system();
+    int index = topology.indexOf(node);
+    if(index < 0){
+        std::cerr << "No NUMA node " << node << ", using the shared pool" << std::endl;
+        return instance();
+    }
+    static std::mutex mutex;
+    static std::vector<std::unique_ptr<ThreadPool>> pools(topology.size());
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!pools[index]){
+        const std::vector<int>& cpus = topology.nodes[index];
+        pools[index] = std::make_unique<ThreadPool>(static_cast<unsigned int>(cpus.size()), cpus);
+    }
+    return *pools[index];
+}
+
+// Workers know their pool; any other thread uses the shared one
+ThreadPool& ThreadPool::current(){
+    return current_pool ? *current_pool : instance();
+}
+
+// Index of the calling thread among this pool's workers
+int ThreadPool::worker_index() const {
+    return current_pool == this ? current_index : -1;
+}
+
+// Workers push onto their own deque; other threads spread their tasks round robin
+void ThreadPool::push(Task task){
+    int index = worker_index();
+    unsigned int target = index >= 0 ? static_cast<unsigned int>(index) : next_queue.fetch_add(1) % size();
+    LoopState* loop = task.loop;
+    queued.fetch_add(1);
+    if(loop){
+        loop->pending.fetch_add(1);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[target]->mutex);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    // Taking the lock orders the push before any sleeper's check of the counters
+    bool has_waiters;
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        has_waiters = waiting > 0;
+    }
+    work_cv.notify_one();
+    if(has_waiters && loop){
+        loop_cv.notify_all();
+    }
+}
+
+// Submitted tasks belong to no loop, so only idle workers run them
+void ThreadPool::submit(std::function<void()> task){
+    Task submitted;
+    submitted.job = std::move(task);
+    push(std::move(submitted));
+}
+
+// The newest task of the own deque keeps its data in cache; otherwise steal the oldest,
+// and so largest, task of another deque. With a loop given, only its tasks are taken.
+bool ThreadPool::try_pop(Task& task, const LoopState* loop){
+    // Takes the first matching task from one end of a deque
+    auto take = [&](WorkerQueue& queue, bool from_back){
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        for(std::size_t k = 0; k < queue.tasks.size(); ++k){
+            auto it = from_back ? queue.tasks.end() - 1 - k : queue.tasks.begin() + k;
+            if(loop == nullptr || it->loop == loop){
+                task = std::move(*it);
+                queue.tasks.erase(it);
+                queued.fetch_sub(1);
+                if(task.loop){
+                    task.loop->pending.fetch_sub(1);
+                }
+                return true;
+            }
+        }
+        return false;
+    };
+
+    int index = worker_index();
+    if(index >= 0 && take(*queues[index], true)){
+        return true;
+    }
+    unsigned int n_queues = size();
+    unsigned int start = index >= 0 ? static_cast<unsigned int>(index) + 1 : next_queue.load();
+    for(unsigned int k = 0; k < n_queues; ++k){
+        unsigned int victim = (start + k) % n_queues;
+        if(static_cast<int>(victim) != index && take(*queues[victim], false)){
+            return true;
+        }
+    }
+    return false;
+}
+
+// A loop range splits further; a submitted task just runs
+void ThreadPool::run(Task& task){
+    TraceScope trace("task", "pool");
+    if(task.loop){
+        run_range(*task.loop, task.begin, task.end);
+    }
+    else{
+        task.job();
+    }
+}
+
+// Help with the loop's queued tasks until all of it has finished; sleep when none are queued
+void ThreadPool::wait_for(LoopState& state){
+    while(state.remaining.load() != 0){
+        Task task;
+        if(try_pop(task, &state)){
+            run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        ++waiting;
+        loop_cv.wait(lock, [&]{ return state.pending.load() > 0 || state.remaining.load() == 0; });
+        --waiting;
+    }
+}
+
+// Workers run tasks until the pool is stopping and every deque is empty
+void ThreadPool::worker_loop(unsigned int index){
+    current_pool = this;
+    current_index = static_cast<int>(index);
+    if(!cpus.empty()){
+        pin_thread(cpus[index % cpus.size()]);
+    }
+    setTraceThreadName("pool " + std::to_string(number) + " worker " + std::to_string(index));
+    while(true){
+        Task task;
+        if(try_pop(task, nullptr)){
+            run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        work_cv.wait(lock, [this]{ return stopping || queued.load() > 0; });
+        if(stopping && queued.load() == 0){
+            return;
+        }
+    }
+}
+
+// Split off the upper half until the range is down to the grain, leaving the halves
+// for thieves, then run what is left here
+void ThreadPool::run_range(LoopState& state, int begin, int end){
+    while(end - begin > state.grain){
+        int middle = begin + (end - begin) / 2;
+        push(Task{&state, middle, end, {}});
+        end = middle;
+    }
+    state.body(begin, end);
+    if(state.remaining.fetch_sub(end - begin) == end - begin){
+        // Last range of the loop: wake the caller if it is asleep
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+        }
+        loop_cv.notify_all();
+    }
+}
+
+// Run body over [begin, end), splitting the range on demand
+void ThreadPool::parallelFor(int begin, int end, FunctionRef<void(int, int)> body, int grain){
+    if(end <= begin){
+        return;
+    }
+
+    // Aim for a few ranges per worker so stolen halves still balance out
+    int n_items = end - begin;
+    if(grain <= 0){
+        grain = std::max(1, n_items / (static_cast<int>(size()) * 8));
+    }
+    if(n_items <= grain){
+        body(begin, end);
+        return;
+    }
+
+    LoopState state{body, grain, {n_items}};
+
+    // The caller splits and runs the first range, then helps until every range is done
+    run_range(state, begin, end);
+    wait_for(state);
+}
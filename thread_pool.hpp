@@ -0,0 +1,113 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <vector> // Standard vector class for the worker list.
+#include <memory> // Owning pointers to the worker deques.
+#include <atomic> // Task and round-robin counters.
+#include <thread> // Worker threads.
+#include <mutex> // Mutexes protecting the deques and the sleep state.
+#include <condition_variable> // Wakes idle threads when tasks arrive or a loop finishes.
+#include <functional> // Function objects for submitted tasks.
+#include "function_ref.hpp" // Loop bodies, referenced without allocating.
+#include "numa_topology.hpp" // CPUs of every NUMA node for pinned pools.
+
+// CancellationToken asks running work to stop early. Copies share one flag, so a token handed
+// to a detector can be cancelled from any thread, e.g. by a timeout. A default-constructed
+// token is never cancelled.
+class CancellationToken{
+public:
+    static CancellationToken make(){ CancellationToken token; token.flag = std::make_shared<std::atomic<bool>>(false); return token; } // A token that can be cancelled.
+    void cancel() const { if(flag) flag->store(true, std::memory_order_relaxed); } // Requests cancellation.
+    bool isCancelled() const { return flag && flag->load(std::memory_order_relaxed); } // True once cancel() was called.
+    bool cancellable() const { return flag != nullptr; } // False for a default-constructed token.
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag; // Shared by all copies, null if the token cannot be cancelled.
+};
+
+// ThreadPool keeps a fixed set of worker threads alive for the lifetime of the process
+// so that detector passes can be split across cores without spawning threads per call.
+// Scheduling is work stealing: every worker owns a deque, runs its own tasks newest first
+// and, when it runs dry, steals the oldest (largest) task from another worker. A thread
+// waiting for a loop only helps with tasks of that loop, so the scratch buffers of the work
+// it is waiting in are never reused by an unrelated task.
+//
+// Workers can be pinned to CPUs, one CPU per worker in turn. The shared pool is pinned when the
+// EDGE_DETECTOR_PIN_THREADS environment variable is set (to anything but 0), and forNode()
+// keeps one pool pinned to the CPUs of each NUMA node, so that images processed there stay
+// in that node's memory.
+class ThreadPool{
+public:
+    // Constructors and destructors.
+    explicit ThreadPool(unsigned int n_threads = std::thread::hardware_concurrency()); // Starts the worker threads.
+    ThreadPool(unsigned int n_threads, std::vector<int> cpus); // Starts workers pinned to the CPUs in turn; empty cpus pins none.
+    ~ThreadPool(); // Stops and joins the worker threads.
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Process-wide pool shared by all EdgeDetector instances.
+    static ThreadPool& instance();
+    // Pool pinned to the CPUs of a NUMA node, given by its kernel number, with a worker per CPU,
+    // created on first use; the shared pool if the node is not listed.
+    static ThreadPool& forNode(int node);
+    // Pool of the calling worker thread, else the shared pool; parallel loops started by a
+    // task stay on the pool the task runs on.
+    static ThreadPool& current();
+
+    // Runs body(chunk_begin, chunk_end) over [begin, end) on the pool. A range splits in halves
+    // down to grain items (0 picks a grain from the pool size); the halves are pushed on the
+    // running thread's deque where idle workers can steal them. The calling thread runs the
+    // loop's own tasks while it waits, so nested calls cannot deadlock. Once the deques have
+    // grown to the loop's depth, a loop allocates nothing: its state lives on the caller's
+    // stack and a task is just a range of it.
+    void parallelFor(int begin, int end, FunctionRef<void(int, int)> body, int grain = 0);
+
+    // Queues a task for any worker and returns at once, e.g. to run a detector call asynchronously.
+    void submit(std::function<void()> task);
+
+    unsigned int size() const { return static_cast<unsigned int>(queues.size()); } // Number of worker threads.
+    const std::vector<int>& pinnedCpus() const { return cpus; } // CPUs the workers are pinned to, empty if not pinned.
+
+private:
+    struct LoopState; // Progress of one parallelFor call.
+
+    // A queued piece of work: a range of a loop, or a submitted function.
+    struct Task{
+        LoopState* loop = nullptr; // Loop the range belongs to, null for a submitted task.
+        int begin = 0; // First item of the range.
+        int end = 0; // One past the last item of the range.
+        std::function<void()> job; // Submitted work, empty for a loop range.
+    };
+
+    // Tasks owned by one worker; the vector keeps its capacity, so pushing allocates only
+    // while it grows to the deepest split seen.
+    struct WorkerQueue{
+        std::mutex mutex; // Guards tasks.
+        std::vector<Task> tasks; // Owner works at the back, thieves take the front.
+    };
+
+    std::vector<std::thread> workers; // Worker threads.
+    std::vector<int> cpus; // CPU of worker t is cpus[t % cpus.size()]; empty if not pinned.
+    std::vector<std::unique_ptr<WorkerQueue>> queues; // One task queue per worker.
+    std::atomic<int> queued{0}; // Tasks waiting in all deques.
+    std::atomic<unsigned int> next_queue{0}; // Round-robin target for tasks pushed from outside the pool.
+    std::mutex sleep_mutex; // Guards stopping, waiting and the sleep/wake handshake.
+    std::condition_variable work_cv; // Wakes idle workers for new tasks or shutdown.
+    std::condition_variable loop_cv; // Wakes threads waiting for a loop on its new tasks or completion.
+    int waiting = 0; // Threads asleep on loop_cv.
+    bool stopping = false; // Set when the pool is being destroyed.
+    int number = 0; // Pools created before this one; names the workers in traces.
+
+    void push(Task task); // Queues a task on the running worker's deque, or round robin.
+    bool try_pop(Task& task, const LoopState* loop); // Takes a task, of the given loop if not null, from the own deque, else steals one.
+    void wait_for(LoopState& state); // Runs tasks of a loop until all of it has finished.
+    void run(Task& task); // Runs a popped task.
+    void run_range(LoopState& state, int begin, int end); // Splits and runs part of a loop.
+    void worker_loop(unsigned int index); // Main loop run by every worker thread.
+    void start(unsigned int n_threads); // Creates the deques and starts the workers.
+    int worker_index() const; // Index of the calling worker in this pool, -1 for other threads.
+};
+
+#endif // THREAD_POOL_HPP
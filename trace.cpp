@@ -0,0 +1,211 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+// One recorded event
+struct Event{
+    const char* name; // Event name.
+    const char* category; // Event category.
+    std::uint64_t begin; // Ticks at the start.
+    std::uint64_t end; // Ticks at the end.
+    std::int64_t id; // Argument, negative for none.
+    bool async; // Overlaps other events of the thread.
+};
+
+// A block of events. The owner writes an event, then publishes it by raising count, so a
+// reader that loads count sees every event below it complete.
+struct Chunk{
+    static constexpr std::size_t capacity = 4096; // Events per chunk.
+    std::array<Event, capacity> events; // Events, the first count of them published.
+    std::atomic<std::size_t> count{0}; // Published events.
+    std::atomic<Chunk*> next{nullptr}; // Following chunk, null if none yet.
+};
+
+// Events of one thread. Chunks are kept from trace to trace and reused, and the buffer
+// outlives its thread so that the events of finished threads can still be written.
+struct ThreadBuffer{
+    int tid = 0; // Thread number in the trace.
+    std::string name; // Name set by the thread; guarded by the registry mutex.
+    std::atomic<Chunk*> head{nullptr}; // First chunk.
+    std::atomic<std::uint64_t> generation{0}; // Trace the published events belong to.
+    std::atomic<std::uint64_t> dropped{0}; // Events dropped since the trace started.
+    Chunk* tail = nullptr; // Chunk being filled, null before the first event; owner only.
+    std::size_t size = 0; // Events recorded in this trace; owner only.
+
+    ~ThreadBuffer(){
+        Chunk* chunk = head.load(std::memory_order_relaxed);
+        while(chunk){
+            Chunk* next = chunk->next.load(std::memory_order_relaxed);
+            delete chunk;
+            chunk = next;
+        }
+    }
+};
+
+// Every thread's buffer, in order of creation
+struct Registry{
+    std::mutex mutex; // Guards buffers and the thread names.
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers; // Buffers of all threads that traced or were named.
+};
+
+Registry& registry(){
+    static Registry instance;
+    return instance;
+}
+
+std::atomic<std::uint64_t> trace_generation{0}; // Number of the current trace.
+std::atomic<std::uint64_t> trace_start{0}; // Ticks when it started.
+thread_local std::shared_ptr<ThreadBuffer> own_buffer; // Buffer of the calling thread.
+
+// The calling thread's buffer; registering it is the only step that takes a lock
+ThreadBuffer& thread_buffer(){
+    if(!own_buffer){
+        auto buffer = std::make_shared<ThreadBuffer>();
+        Registry& threads = registry();
+        std::lock_guard<std::mutex> lock(threads.mutex);
+        buffer->tid = static_cast<int>(threads.buffers.size()) + 1;
+        threads.buffers.push_back(buffer);
+        own_buffer = std::move(buffer);
+    }
+    return *own_buffer;
+}
+
+// Append to the own buffer without locking, moving on to the next chunk when one is full
+void record(const Event& event){
+    ThreadBuffer& buffer = thread_buffer();
+    std::uint64_t generation = trace_generation.load(std::memory_order_acquire);
+    if(buffer.generation.load(std::memory_order_relaxed) != generation){
+        for(Chunk* chunk = buffer.head.load(std::memory_order_relaxed); chunk; chunk = chunk->next.load(std::memory_order_relaxed)){
+            chunk->count.store(0, std::memory_order_relaxed);
+        }
+        buffer.tail = nullptr;
+        buffer.size = 0;
+        buffer.dropped.store(0, std::memory_order_relaxed);
+        buffer.generation.store(generation, std::memory_order_release);
+    }
+    if(buffer.size >= trace_events_per_thread){
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if(!buffer.tail || buffer.tail->count.load(std::memory_order_relaxed) == Chunk::capacity){
+        std::atomic<Chunk*>& link = buffer.tail ? buffer.tail->next : buffer.head;
+        Chunk* chunk = link.load(std::memory_order_relaxed);
+        if(!chunk){
+            chunk = new Chunk;
+            link.store(chunk, std::memory_order_release);
+        }
+        buffer.tail = chunk;
+    }
+    std::size_t n = buffer.tail->count.load(std::memory_order_relaxed);
+    buffer.tail->events[n] = event;
+    buffer.tail->count.store(n + 1, std::memory_order_release);
+    ++buffer.size;
+}
+
+// Quotes a string for JSON
+std::string json_string(const std::string& text){
+    std::string quoted = "\"";
+    for(char c : text){
+        if(c == '"' || c == '\\'){
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+}
+
+// A new generation makes every thread empty its buffer on its next event
+void setTracing(bool enabled){
+    if(enabled){
+        trace_start.store(readTicks(), std::memory_order_relaxed);
+        trace_generation.fetch_add(1, std::memory_order_release);
+    }
+    trace_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void traceEvent(const char* name, const char* category, std::uint64_t begin, std::uint64_t end, std::int64_t id){
+    record(Event{name, category, begin, end, id, false});
+}
+
+void traceAsyncEvent(const char* name, const char* category, std::uint64_t begin, std::uint64_t end, std::int64_t id){
+    record(Event{name, category, begin, end, id, true});
+}
+
+// Stages are named as in the stage statistics
+void traceStage(Stage stage, std::uint64_t begin, std::uint64_t end){
+    traceEvent(stageName(stage), "stage", begin, end);
+}
+
+void setTraceThreadName(const std::string& name){
+    ThreadBuffer& buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    buffer.name = name;
+}
+
+// Complete ("X") events, or begin and end ("b", "e") pairs for async ones, in microseconds from
+// the start of the trace, with a name for every thread
+bool writeTrace(const std::string& filename){
+    std::ofstream file(filename);
+    if(!file){
+        std::cerr << "Could not write trace " << filename << std::endl;
+        return false;
+    }
+    std::uint64_t generation = trace_generation.load(std::memory_order_acquire);
+    std::uint64_t start = trace_start.load(std::memory_order_relaxed);
+    double microseconds_per_tick = secondsPerTick() * 1e6;
+    std::uint64_t dropped = 0;
+
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    file << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"edge detector\"}}";
+    Registry& threads = registry();
+    std::lock_guard<std::mutex> lock(threads.mutex);
+    for(const auto& buffer : threads.buffers){
+        std::string name = buffer->name.empty() ? "thread " + std::to_string(buffer->tid) : buffer->name;
+        file << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->tid
+             << ", \"args\": {\"name\": " << json_string(name) << "}}";
+        if(buffer->generation.load(std::memory_order_acquire) != generation){
+            continue;
+        }
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+        for(Chunk* chunk = buffer->head.load(std::memory_order_acquire); chunk; chunk = chunk->next.load(std::memory_order_acquire)){
+            std::size_t n = chunk->count.load(std::memory_order_acquire);
+            for(std::size_t k = 0; k < n; ++k){
+                const Event& event = chunk->events[k];
+                double begin = event.begin > start ? (event.begin - start) * microseconds_per_tick : 0.0;
+                double duration = event.end > event.begin ? (event.end - event.begin) * microseconds_per_tick : 0.0;
+                std::string common = "{\"name\": " + json_string(event.name) + ", \"cat\": " + json_string(event.category)
+                                     + ", \"pid\": 1, \"tid\": " + std::to_string(buffer->tid);
+                if(event.async){
+                    std::string id = std::to_string(std::max<std::int64_t>(event.id, 0));
+                    file << ",\n" << common << ", \"ph\": \"b\", \"id\": " << id << ", \"ts\": " << begin << "}";
+                    file << ",\n" << common << ", \"ph\": \"e\", \"id\": " << id << ", \"ts\": " << begin + duration << "}";
+                    continue;
+                }
+                file << ",\n" << common << ", \"ph\": \"X\", \"ts\": " << begin << ", \"dur\": " << duration;
+                if(event.id >= 0){
+                    file << ", \"args\": {\"id\": " << event.id << "}";
+                }
+                file << "}";
+            }
+        }
+    }
+    file << "\n]}\n";
+    if(dropped > 0){
+        std::cerr << "Trace buffers were full, " << dropped << " events dropped" << std::endl;
+    }
+    if(!file){
+        std::cerr << "Could not write trace " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <cstddef> // Event limit.
+#include <cstdint> // Tick counts and event ids.
+#include <string> // Thread names and file names.
+#include "stage_timer.hpp" // Timer ticks and the tracing flag.
+
+// Tracing records what every thread did and when, for viewing as a timeline: the stages of
+// every call, the tasks run by pool workers, frames of batches and of the deadline scheduler,
+// and the time frames spend waiting in queues. Events go to a buffer owned by the recording
+// thread, appended without locks, and writeTrace() saves them as Chrome trace JSON, which
+// opens in Perfetto (ui.perfetto.dev) or chrome://tracing. While tracing is off, a traced
+// scope costs one relaxed load of a flag.
+//
+// Each thread keeps up to trace_events_per_thread events per trace; later ones are dropped
+// and counted. Stage events come from the stage timers, so a build with
+// EDGE_DETECTOR_NO_STAGE_TIMERS traces tasks and frames only.
+
+constexpr std::size_t trace_events_per_thread = std::size_t(1) << 20; // Events kept per thread and trace.
+
+// Starts a new trace, discarding the events of the previous one, or stops recording; the events
+// recorded stay available to writeTrace() until the next trace starts.
+void setTracing(bool enabled);
+inline bool tracingEnabled(){ return trace_enabled.load(std::memory_order_relaxed); } // True while a trace is recorded.
+
+// Records an event of the calling thread from begin to end (readTicks() values). Name and
+// category must be string literals or otherwise outlive the trace; id, if not negative, is
+// shown as the event's argument (e.g. a frame number).
+void traceEvent(const char* name, const char* category, std::uint64_t begin, std::uint64_t end, std::int64_t id = -1);
+// Same for an interval that may overlap others of the thread, such as a frame waiting in a
+// queue; viewers show it on a row of its own, keyed by category and id.
+void traceAsyncEvent(const char* name, const char* category, std::uint64_t begin, std::uint64_t end, std::int64_t id);
+
+// Names the calling thread in the trace; unnamed threads are shown as "thread N".
+void setTraceThreadName(const std::string& name);
+
+// Writes the events of the current or last trace as Chrome trace JSON; returns false if the
+// file cannot be written. Best called once the traced work has finished: events still being
+// recorded may be missing, and a trace must not be restarted while it is written.
+bool writeTrace(const std::string& filename);
+
+// TraceScope records an event lasting until the end of the scope, if tracing was on when it began.
+class TraceScope{
+public:
+    TraceScope(const char* name, const char* category, std::int64_t id = -1)
+        : name(name), category(category), id(id), begin(tracingEnabled() ? readTicks() : 0){}
+    ~TraceScope(){
+        if(begin){
+            traceEvent(name, category, begin, readTicks(), id);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name; // Event name.
+    const char* category; // Event category.
+    std::int64_t id; // Event argument, negative for none.
+    std::uint64_t begin; // Ticks at the start, 0 if not traced.
+};
+
+#endif // TRACE_HPP
@@ -0,0 +1,112 @@
+#include "workspace.hpp"
+
+#include <algorithm>
+
+// Every thread gets its own workspace, so detectors called from several threads never share scratch
+Workspace& Workspace::forThread(){
+    thread_local Workspace workspace;
+    return workspace;
+}
+
+// The slot's byte buffer, grown when the request is larger than any before
+unsigned char* Workspace::bytes(int slot, std::size_t size){
+    Entry<std::vector<unsigned char>>& entry = byte_buffers[slot];
+    grow(entry, size);
+    return entry.buffer.data();
+}
+
+// Byte buffers come from operator new, so they are aligned for 64-bit counters
+std::uint64_t* Workspace::counters(int slot, std::size_t n){
+    std::uint64_t* counts = reinterpret_cast<std::uint64_t*>(bytes(slot, n * sizeof(std::uint64_t)));
+    std::fill(counts, counts + n, std::uint64_t(0));
+    return counts;
+}
+
+namespace {
+// Bytes allocated by one buffer
+template<typename Vector>
+std::size_t held(const Vector& buffer){ return buffer.capacity() * sizeof(typename Vector::value_type); }
+template<typename Scalar>
+std::size_t held(const BasicPaddedPlane<Scalar>& plane){ return plane.capacityBytes(); }
+
+// Size of the largest buffer of a map that holds more than was requested of it
+template<typename Map>
+std::size_t largest_spare(const Map& buffers){
+    std::size_t size = 0;
+    for(const auto& entry : buffers){
+        std::size_t bytes = held(entry.second.buffer);
+        if(bytes > entry.second.used){
+            size = std::max(size, bytes);
+        }
+    }
+    return size;
+}
+
+// Releases a spare buffer of the given size, if the map has one
+template<typename Map>
+bool release(Map& buffers, std::size_t size){
+    for(auto it = buffers.begin(); it != buffers.end(); ++it){
+        if(held(it->second.buffer) == size && size > it->second.used){
+            buffers.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Forgets the requests of every buffer of a map
+template<typename Map>
+void forget(Map& buffers){
+    for(auto& entry : buffers){
+        entry.second.used = 0;
+    }
+}
+}
+
+// Sum over every map
+std::size_t Workspace::heldBytes() const{
+    std::size_t total = 0;
+    auto add = [&total](const auto& buffers){
+        for(const auto& entry : buffers){
+            total += held(entry.second.buffer);
+        }
+    };
+    add(matrices);
+    add(float_matrices);
+    add(planes);
+    add(float_planes);
+    add(byte_buffers);
+    return total;
+}
+
+// Release the largest spare buffer, wherever it is, until the rest fits or only buffers in use are left
+void Workspace::trim(std::size_t limit){
+    while(heldBytes() > limit){
+        std::size_t size = std::max({largest_spare(matrices), largest_spare(float_matrices), largest_spare(planes),
+                                     largest_spare(float_planes), largest_spare(byte_buffers)});
+        if(size == 0 || (!release(matrices, size) && !release(float_matrices, size) && !release(planes, size) &&
+                         !release(float_planes, size) && !release(byte_buffers, size))){
+            break;
+        }
+    }
+    forget(matrices);
+    forget(float_matrices);
+    forget(planes);
+    forget(float_planes);
+    forget(byte_buffers);
+}
+
+// Start counting from zero
+void Workspace::resetCounters(){
+    allocation_count = 0;
+    allocated_bytes = 0;
+}
+
+// Drop all buffers; the next calls allocate them again
+void Workspace::clear(){
+    matrices.clear();
+    float_matrices.clear();
+    planes.clear();
+    float_planes.clear();
+    byte_buffers.clear();
+}
@@ -0,0 +1,143 @@
+#ifndef WORKSPACE_HPP
+#define WORKSPACE_HPP
+
+// Include statements for necessary libraries and dependencies.
+#include <Eigen/Dense> // Eigen matrices held by the workspace.
+#include <map> // Buffers by slot.
+#include <vector> // Buffer storage.
+#include <cstddef> // Size type for counters.
+#include <cstdint> // Histogram counters.
+#include <type_traits> // Dispatch on the scalar type.
+#include <algorithm> // Largest request per slot.
+#include "padded_plane.hpp" // Padded planes held by the workspace.
+
+// Workspace owns scratch buffers that are reused across detector calls. Each caller-chosen slot
+// holds one buffer that only grows, so a stream of frames finds every buffer already allocated,
+// and frames of many sizes cost no more memory than the largest of them. trim() gives memory
+// back under a budget. The counters record every allocation the workspace makes, which makes
+// it easy to check that steady-state processing does not touch the heap.
+// A workspace is not thread-safe; use one per thread, e.g. the one returned by forThread().
+class Workspace{
+public:
+    // Matrix over a slot's buffer; valid until the slot is requested with a larger size.
+    template<typename Scalar>
+    using Scratch = Eigen::Map<Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>, Eigen::Aligned64>;
+
+    // Constructors and destructors.
+    Workspace() = default; // Empty workspace.
+    ~Workspace() = default; // Releases all buffers.
+
+    // Workspace of the calling thread, created on first use.
+    static Workspace& forThread();
+
+    // Returns a rows x cols matrix over the slot's buffer, growing it first if it is too small.
+    // The contents are whatever the slot held before.
+    template<typename Scalar = double>
+    Scratch<Scalar> matrix(int slot, Eigen::Index rows, Eigen::Index cols){
+        Entry<Buffer<Scalar>>& entry = matrices_of<Scalar>()[slot];
+        grow(entry, static_cast<std::size_t>(rows * cols));
+        return Scratch<Scalar>(entry.buffer.data(), rows, cols);
+    }
+    // Returns the padded plane for a slot shaped (rows, cols, halo); its storage only grows.
+    template<typename Scalar = double>
+    BasicPaddedPlane<Scalar>& plane(int slot, int rows, int cols, int halo){
+        Entry<BasicPaddedPlane<Scalar>>& entry = planes_of<Scalar>()[slot];
+        ensureSize(entry.buffer, rows, cols, halo);
+        entry.used = std::max(entry.used, entry.buffer.bytes());
+        return entry.buffer;
+    }
+    // Returns at least size bytes of the slot's buffer, growing it first if it is too small.
+    unsigned char* bytes(int slot, std::size_t size);
+    // Returns n zeroed counters, e.g. the bins of a histogram, over the slot's byte buffer.
+    std::uint64_t* counters(int slot, std::size_t n);
+    // Resizes a matrix owned elsewhere, counting the allocation if the shape changes.
+    // Eigen only reallocates when the number of coefficients changes.
+    template<typename Derived>
+    void ensureSize(Eigen::PlainObjectBase<Derived>& matrix, Eigen::Index rows, Eigen::Index cols){
+        if(matrix.rows() == rows && matrix.cols() == cols){
+            return;
+        }
+        if(matrix.size() != rows * cols){
+            count_allocation(static_cast<std::size_t>(rows * cols) * sizeof(typename Derived::Scalar));
+        }
+        matrix.resize(rows, cols);
+    }
+    // Reshapes a padded plane owned elsewhere, counting the allocation if its storage grows.
+    template<typename Plane>
+    void ensureSize(Plane& plane, int rows, int cols, int halo){
+        if(plane.reshape(rows, cols, halo)){
+            count_allocation(plane.bytes());
+        }
+    }
+
+    void recordAllocation(std::size_t bytes){ count_allocation(bytes); } // Counts an allocation made on the workspace's behalf.
+
+    std::size_t allocationCount() const { return allocation_count; } // Allocations since the last reset.
+    std::size_t allocatedBytes() const { return allocated_bytes; } // Bytes allocated since the last reset.
+    std::size_t heldBytes() const; // Bytes held by all buffers, e.g. to count against a memory budget.
+    void resetCounters(); // Zeroes the counters, e.g. after a warm-up frame.
+    // Releases buffers until at most limit bytes are held, largest first, among those not requested
+    // since the last trim and those larger than any request since then; the buffers in use are
+    // kept whatever the limit. Then starts tracking requests anew.
+    void trim(std::size_t limit);
+    void clear(); // Releases every buffer.
+
+private:
+    template<typename Scalar>
+    using Buffer = std::vector<Scalar, AlignedAllocator<Scalar>>; // Aligned storage of one slot.
+
+    // The buffer of one slot and the most of it requested since the last trim.
+    template<typename Storage>
+    struct Entry{
+        Storage buffer; // Matrix elements, plane or bytes.
+        std::size_t used = 0; // Largest request in bytes since the last trim, 0 if none.
+    };
+
+    std::map<int, Entry<Buffer<double>>> matrices; // Double matrix buffers by slot.
+    std::map<int, Entry<Buffer<float>>> float_matrices; // Float matrix buffers by slot.
+    std::map<int, Entry<BasicPaddedPlane<double>>> planes; // Double padded planes by slot.
+    std::map<int, Entry<BasicPaddedPlane<float>>> float_planes; // Float padded planes by slot.
+    std::map<int, Entry<std::vector<unsigned char>>> byte_buffers; // Byte buffers by slot.
+    std::size_t allocation_count = 0; // Number of allocations made.
+    std::size_t allocated_bytes = 0; // Total bytes allocated.
+
+    // Buffer map for a scalar type.
+    template<typename Scalar>
+    std::map<int, Entry<Buffer<Scalar>>>& matrices_of(){
+        static_assert(std::is_same<Scalar, double>::value || std::is_same<Scalar, float>::value, "Workspace holds double or float matrices");
+        if constexpr(std::is_same<Scalar, double>::value){
+            return matrices;
+        } else {
+            return float_matrices;
+        }
+    }
+    // Padded plane map for a scalar type.
+    template<typename Scalar>
+    std::map<int, Entry<BasicPaddedPlane<Scalar>>>& planes_of(){
+        static_assert(std::is_same<Scalar, double>::value || std::is_same<Scalar, float>::value, "Workspace holds double or float planes");
+        if constexpr(std::is_same<Scalar, double>::value){
+            return planes;
+        } else {
+            return float_planes;
+        }
+    }
+    // Replaces a buffer smaller than size elements by one of exactly that size; the old contents are dropped.
+    template<typename Vector>
+    void grow(Entry<Vector>& entry, std::size_t size){
+        std::size_t bytes = size * sizeof(typename Vector::value_type);
+        entry.used = std::max(entry.used, bytes);
+        if(size <= entry.buffer.size()){
+            return;
+        }
+        Vector().swap(entry.buffer);
+        entry.buffer.resize(size);
+        count_allocation(bytes);
+    }
+    // Records one allocation of the given size.
+    void count_allocation(std::size_t bytes){
+        allocation_count++;
+        allocated_bytes += bytes;
+    }
+};
+
+#endif // WORKSPACE_HPP